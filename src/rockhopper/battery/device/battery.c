@@ -36,41 +36,96 @@
 #include "batterylib.h"
 #include "battery_read.h"
 #include "utils.h"
+#include "sysfs_attr.h"
+#include "power_supply_hub.h"
 
 #include <nyx/module/nyx_log.h>
 #include <glib.h>
-#include <libudev.h>
 
 #define CHARGE_MIN_TEMPERATURE_C 0
 #define CHARGE_MAX_TEMPERATURE_C 57
 #define BATTERY_MAX_TEMPERATURE_C  60
 
-#define PATH_LEN 128
-
-char* battery_sysfs_path = NULL;
-GIOChannel *channel;
+const char *battery_sysfs_path = NULL;
 
 nyx_battery_ctia_t battery_ctia_params;
 nyx_battery_status_t *curr_state;
 
-struct udev *udev;
-struct udev_monitor *mon;
-
 extern nyx_device_t *nyxDev;
 extern void *battery_callback_context;
 extern nyx_device_callback_function_t battery_callback;
 
-char batt_capacity_path[PATH_LEN] = {0,};
-char batt_energy_now_path[PATH_LEN] = {0,};
-char batt_energy_full_path[PATH_LEN] = {0,};
-char batt_energy_full_design_path[PATH_LEN] = {0,};
-char batt_charge_now_path[PATH_LEN] = {0,};
-char batt_charge_full_path[PATH_LEN] = {0,};
-char batt_charge_full_design_path[PATH_LEN] = {0,};
-char batt_temperature_path[PATH_LEN] = {0,};
-char batt_voltage_path[PATH_LEN] = {0,};
-char batt_current_path[PATH_LEN] = {0,};
-char batt_present_path[PATH_LEN] = {0,};
+/* Battery attributes read from the power_supply class */
+typedef enum
+{
+	BATT_CAPACITY = 0,
+	BATT_ENERGY_NOW,
+	BATT_ENERGY_FULL,
+	BATT_CHARGE_NOW,
+	BATT_CHARGE_FULL,
+	BATT_CHARGE_FULL_DESIGN,
+	BATT_TEMPERATURE,
+	BATT_VOLTAGE,
+	BATT_CURRENT,
+	BATT_PRESENT,
+	BATT_NUM_ATTRS
+} battery_attr_t;
+
+/**
+ * Sysfs attribute kept open from detection on, so a refresh costs one
+ * pread() per attribute. Attributes the battery does not provide stay
+ * closed; they are not probed again.
+ */
+typedef struct
+{
+	const char *name;
+	sysfs_attr_t attr;
+} battery_attr_file_t;
+
+static battery_attr_file_t batt_attrs[BATT_NUM_ATTRS] =
+{
+	[BATT_CAPACITY]             = { "capacity", SYSFS_ATTR_INIT },
+	[BATT_ENERGY_NOW]           = { "energy_now", SYSFS_ATTR_INIT },
+	[BATT_ENERGY_FULL]          = { "energy_full", SYSFS_ATTR_INIT },
+	[BATT_CHARGE_NOW]           = { "charge_now", SYSFS_ATTR_INIT },
+	[BATT_CHARGE_FULL]          = { "charge_full", SYSFS_ATTR_INIT },
+	[BATT_CHARGE_FULL_DESIGN]   = { "charge_full_design", SYSFS_ATTR_INIT },
+	[BATT_TEMPERATURE]          = { "temp", SYSFS_ATTR_INIT },
+	[BATT_VOLTAGE]              = { "voltage_now", SYSFS_ATTR_INIT },
+	[BATT_CURRENT]              = { "current_now", SYSFS_ATTR_INIT },
+	[BATT_PRESENT]              = { "present", SYSFS_ATTR_INIT },
+};
+
+/**
+ * @brief Check whether the battery provides an attribute
+ */
+static bool battery_has_attr(battery_attr_t attr)
+{
+	return sysfs_attr_is_open(&batt_attrs[attr].attr);
+}
+
+/**
+ * @brief Read an integer attribute from its cached descriptor
+ *
+ * @retval Attribute value, -1 if missing or unreadable
+ */
+static int battery_read_attr(battery_attr_t attr)
+{
+	long value;
+
+	if (!battery_has_attr(attr))
+	{
+		return -1;
+	}
+
+	if (sysfs_attr_read_int(&batt_attrs[attr].attr, &value) < 0)
+	{
+		nyx_error("%s: Invalid value in %s", __FUNCTION__, batt_attrs[attr].name);
+		return -1;
+	}
+
+	return (int) value;
+}
 
 nyx_battery_ctia_t *get_battery_ctia_params(void)
 {
@@ -93,29 +148,29 @@ int battery_percent(void)
 	int capacity;
 
 	/* try capacity node first but keep in mind it's not supported by all power class devices */
-	if (!g_file_test(batt_capacity_path, G_FILE_TEST_EXISTS) || ((capacity = nyx_utils_read_value(batt_capacity_path)) < 0))
+	if ((capacity = battery_read_attr(BATT_CAPACITY)) < 0)
 	{
 		/* capacity node is not available so next try is energy_now/energy_full */
-		if (g_file_test(batt_energy_now_path, G_FILE_TEST_EXISTS) && g_file_test(batt_energy_full_path, G_FILE_TEST_EXISTS))
+		if (battery_has_attr(BATT_ENERGY_NOW) && battery_has_attr(BATT_ENERGY_FULL))
 		{
-			if ((now = nyx_utils_read_value(batt_energy_now_path)) < 0)
+			if ((now = battery_read_attr(BATT_ENERGY_NOW)) < 0)
 			{
 				return -1;
 			}
-			if ((full = nyx_utils_read_value(batt_energy_full_path)) < 0)
+			if ((full = battery_read_attr(BATT_ENERGY_FULL)) < 0)
 			{
 				return -1;
 			}
 			capacity = (now / full);
 		}
 		/* as last try we can use charge_full or charge_now */
-		else if (g_file_test(batt_charge_full_path, G_FILE_TEST_EXISTS) && g_file_test(batt_charge_now_path, G_FILE_TEST_EXISTS))
+		else if (battery_has_attr(BATT_CHARGE_FULL) && battery_has_attr(BATT_CHARGE_NOW))
 		{
-			if ((full = nyx_utils_read_value(batt_charge_full_path)) < 0)
+			if ((full = battery_read_attr(BATT_CHARGE_FULL)) < 0)
 			{
 				return -1;
 			}
-			if ((now = nyx_utils_read_value(batt_charge_now_path)) < 0)
+			if ((now = battery_read_attr(BATT_CHARGE_NOW)) < 0)
 			{
 				return -1;
 			}
@@ -137,7 +192,7 @@ int battery_temperature(void)
 {
 	int temp;
 
-	if (!g_file_test(batt_temperature_path, G_FILE_TEST_EXISTS) ||  ((temp = nyx_utils_read_value(batt_temperature_path)) < 0))
+	if ((temp = battery_read_attr(BATT_TEMPERATURE)) < 0)
 	{
 		return -1;
 	}
@@ -154,7 +209,7 @@ int battery_voltage(void)
 {
 	int voltage;
 
-	if (!g_file_test(batt_voltage_path, G_FILE_TEST_EXISTS) || ((voltage = nyx_utils_read_value(batt_voltage_path)) < 0))
+	if ((voltage = battery_read_attr(BATT_VOLTAGE)) < 0)
 	{
 		return -1;
 	}
@@ -170,7 +225,7 @@ int battery_current(void)
 {
 	signed int current;
 
-	if (!g_file_test(batt_current_path, G_FILE_TEST_EXISTS) || ((current = nyx_utils_read_value(batt_current_path)) < 0))
+	if ((current = battery_read_attr(BATT_CURRENT)) < 0)
 	{
 		return -1;
 	}
@@ -197,9 +252,9 @@ double battery_full40(void)
 {
 	int charge_full;
 
-	if (!g_file_test(batt_charge_full_path, G_FILE_TEST_EXISTS) || ((charge_full = nyx_utils_read_value(batt_charge_full_path)) < 0))
+	if ((charge_full = battery_read_attr(BATT_CHARGE_FULL)) < 0)
 	{
-		if (!g_file_test(batt_charge_full_design_path, G_FILE_TEST_EXISTS) || ((charge_full = nyx_utils_read_value(batt_charge_full_design_path)) < 0))
+		if ((charge_full = battery_read_attr(BATT_CHARGE_FULL_DESIGN)) < 0)
 		{
 			return -1;
 		}
@@ -230,7 +285,7 @@ double battery_coulomb(void)
 {
 	int charge_now;
 
-	if (!g_file_test(batt_charge_now_path, G_FILE_TEST_EXISTS) || ((charge_now = nyx_utils_read_value(batt_charge_now_path)) < 0))
+	if ((charge_now = battery_read_attr(BATT_CHARGE_NOW)) < 0)
 	{
 		return -1;
 	}
@@ -254,7 +309,7 @@ bool battery_is_present(void)
 {
 	int present;
 
-	if (!g_file_test(batt_present_path, G_FILE_TEST_EXISTS) || ((present = nyx_utils_read_value(batt_present_path)) < 0))
+	if ((present = battery_read_attr(BATT_PRESENT)) < 0)
 	{
 		return false;
 	}
@@ -263,59 +318,131 @@ bool battery_is_present(void)
 	return retval;
 }
 
-gboolean _handle_event(GIOChannel *channel, GIOCondition condition, gpointer data)
+/**
+ * @brief Read an attribute from the uevent properties of the battery
+ *
+ * The kernel reports every readable attribute as POWER_SUPPLY_<NAME> in the
+ * change event, so sysfs is only read for attributes the event lacks.
+ *
+ * @retval Attribute value, -1 if missing
+ */
+static int battery_event_attr(const power_supply_t *supply,
+                              power_supply_prop_t prop, battery_attr_t attr)
+{
+	if (!power_supply_has(supply, prop))
+	{
+		return battery_read_attr(attr);
+	}
+
+	return supply->values[prop];
+}
+
+/**
+ * @brief Update the battery status from a power_supply uevent
+ *
+ * Mirrors battery_read_status(), with values taken from the event where
+ * it has them.
+ */
+static void battery_read_event_status(const power_supply_t *supply,
+                                      nyx_battery_status_t *state)
 {
-	struct udev_device *dev;
+	int value;
 
-	if ((condition  & G_IO_IN) == G_IO_IN)
+	memset(state, 0, sizeof(nyx_battery_status_t));
+
+	state->present = (battery_event_attr(supply, PS_PROP_PRESENT, BATT_PRESENT) == 1);
+	if (!state->present)
 	{
-		dev = udev_monitor_receive_device(mon);
-		if (dev)
-		{
-			/*Initiate callback only if battery percentage or present parameters change*/
-			int prev_percentage = curr_state->percentage;
-			bool prev_present = curr_state->present;
+		state->charging = false;
+		return;
+	}
 
-			battery_read_status(curr_state);
-			if ((curr_state->present != prev_present) || (curr_state->percentage != prev_percentage))
-			{
-				battery_callback(nyxDev, NYX_CALLBACK_STATUS_DONE, battery_callback_context);
-			}
-		}
+	if ((state->percentage = battery_event_attr(supply, PS_PROP_CAPACITY, BATT_CAPACITY)) < 0)
+	{
+		state->percentage = battery_percent();
+	}
+
+	value = battery_event_attr(supply, PS_PROP_TEMP, BATT_TEMPERATURE);
+	state->temperature = (value < 0) ? -1 : value;
+	value = battery_event_attr(supply, PS_PROP_CURRENT_NOW, BATT_CURRENT);
+	state->current = (value < 0) ? -1 : value;
+	state->avg_current = state->current;
+	value = battery_event_attr(supply, PS_PROP_VOLTAGE_NOW, BATT_VOLTAGE);
+	state->voltage = (value < 0) ? -1 : value;
+
+	/* Divide the values by 1000 to convert from uAh to mAh */
+	value = battery_event_attr(supply, PS_PROP_CHARGE_NOW, BATT_CHARGE_NOW);
+	state->capacity = (value < 0) ? -1 : (double) value/1000;
+	if ((value = battery_event_attr(supply, PS_PROP_CHARGE_FULL, BATT_CHARGE_FULL)) < 0)
+	{
+		value = battery_event_attr(supply, PS_PROP_CHARGE_FULL_DESIGN, BATT_CHARGE_FULL_DESIGN);
+	}
+	state->capacity_full40 = (value < 0) ? -1 : (double) value/1000;
+
+	state->capacity_raw = battery_rawcoulomb();
+	state->age = battery_age();
+
+	if (state->avg_current > 0)
+	{
+		state->charging = true;
 	}
-	return TRUE;
 }
 
 void _detect_battery_sysfs_paths()
 {
+	int i;
+
 	battery_sysfs_path = find_power_supply_sysfs_path("Battery");
-	if (battery_sysfs_path)
+
+	for (i = 0; i < BATT_NUM_ATTRS; i++)
 	{
-		snprintf (batt_capacity_path, PATH_LEN, "%s/capacity", battery_sysfs_path);
-		snprintf (batt_energy_now_path, PATH_LEN, "%s/energy_now", battery_sysfs_path);
-		snprintf (batt_energy_full_path, PATH_LEN, "%s/energy_full", battery_sysfs_path);
-		snprintf (batt_charge_now_path, PATH_LEN, "%s/charge_now", battery_sysfs_path);
-		snprintf (batt_charge_full_path, PATH_LEN, "%s/charge_full", battery_sysfs_path);
-		snprintf (batt_charge_full_design_path, PATH_LEN, "%s/charge_full_design", battery_sysfs_path);
-		snprintf (batt_temperature_path, PATH_LEN, "%s/temp", battery_sysfs_path);
-		snprintf (batt_voltage_path, PATH_LEN, "%s/voltage_now", battery_sysfs_path);
-		snprintf (batt_current_path, PATH_LEN, "%s/current_now", battery_sysfs_path);
-		snprintf (batt_present_path, PATH_LEN, "%s/present", battery_sysfs_path);
+		if (sysfs_attr_open(&batt_attrs[i].attr, battery_sysfs_path,
+		                    batt_attrs[i].name) < 0 && battery_sysfs_path)
+		{
+			nyx_debug("Battery attribute %s not available", batt_attrs[i].name);
+		}
 	}
 }
 
-nyx_error_t battery_read_init(void)
+static void _handle_event(const power_supply_t *supply, void *context)
 {
-	int fd;
-	fd_set readfds;
+	/*Initiate callback only if battery percentage or present parameters change*/
+	int prev_percentage = curr_state->percentage;
+	bool prev_present = curr_state->present;
 
-	udev = udev_new();
-	if (!udev)
+	/* any supply coming or going, of unknown type too, may change which
+	 * battery is indexed; reopen the attributes of the indexed one */
+	if (power_supply_index_update(supply->name, supply->type, supply->removed))
 	{
-		nyx_error("Could not initialize udev component; battery status updates will not be available");
-		return;
+		_detect_battery_sysfs_paths();
 	}
 
+	/* chargers report their own state, the battery sends a change
+	 * event of its own when they affect it */
+	if (supply->type[0] == '\0')
+	{
+		battery_read_status(curr_state);
+	}
+	else if (power_supply_is_type(supply, "Battery"))
+	{
+		if (supply->removed)
+		{
+			memset(curr_state, 0, sizeof(nyx_battery_status_t));
+		}
+		else
+		{
+			battery_read_event_status(supply, curr_state);
+		}
+	}
+
+	if ((curr_state->present != prev_present) || (curr_state->percentage != prev_percentage))
+	{
+		battery_callback(nyxDev, NYX_CALLBACK_STATUS_DONE, battery_callback_context);
+	}
+}
+
+nyx_error_t battery_read_init(void)
+{
 	/*Initialize the sysfs paths*/
 	_detect_battery_sysfs_paths();
 
@@ -323,29 +450,12 @@ nyx_error_t battery_read_init(void)
 	memset(curr_state, 0, sizeof(nyx_battery_status_t));
 	battery_read_status(curr_state);
 
-	mon = udev_monitor_new_from_netlink(udev, "kernel");
-	if (mon == NULL)
-	{
-		nyx_error("Failed to create udev monitor for kernel events");
-		return NYX_ERROR_GENERIC;
-	}
-	if (udev_monitor_filter_add_match_subsystem_devtype(mon, "power_supply", NULL) < 0)
-	{
-		nyx_error("Failed to setup udev filter for power_supply subsytem events");
-		return NYX_ERROR_GENERIC;
-	}
-
-	if (udev_monitor_enable_receiving(mon) < 0)
+	if (power_supply_hub_subscribe(_handle_event, NULL) < 0)
 	{
-		nyx_error("Failed to enable receiving kernel events for power_supply subsytem\n");
+		nyx_error("Battery status updates will not be available");
 		return NYX_ERROR_GENERIC;
 	}
 
-	fd = udev_monitor_get_fd(mon);
-	channel = g_io_channel_unix_new(fd);
-	g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_NVAL, _handle_event, NULL);
-	g_io_channel_unref(channel);
-
 	return NYX_ERROR_NONE;
 }
 
@@ -29,19 +29,11 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
-#include <libudev.h>
 #include <utils.h>
+#include <sysfs_attr.h>
+#include <power_supply_hub.h>
 
 #include <nyx/nyx_module.h>
-#include <nyx/module/nyx_utils.h>
-
-#define STATUS_LEN 64
-#define PATH_LEN 128
-
-GIOChannel *channel;
-
-struct udev *udev;
-struct udev_monitor *mon;
 
 extern nyx_device_t *nyxDev;
 extern void *charger_status_callback_context;
@@ -50,14 +42,60 @@ extern nyx_device_callback_function_t charger_status_callback;
 extern nyx_device_callback_function_t state_change_callback;
 
 nyx_battery_status_t *curr_battery_state;
-char* battery_status = NULL;
 
-char batt_present_path[PATH_LEN] = {0,};
-char batt_status_path[PATH_LEN] = {0,};
-char charger_usb_sysfs_online_path[PATH_LEN] = {0,};
-char charger_ac_sysfs_online_path[PATH_LEN] = {0,};
-char charger_touch_sysfs_online_path[PATH_LEN] = {0,};
-char charger_wireless_sysfs_online_path[PATH_LEN] = {0,};
+/* Values of the power_supply status attribute */
+typedef enum
+{
+	BATT_STATUS_NONE = -1,              /**< not read yet */
+	BATT_STATUS_UNKNOWN = 0,
+	BATT_STATUS_CHARGING,
+	BATT_STATUS_DISCHARGING,
+	BATT_STATUS_NOT_CHARGING,
+	BATT_STATUS_FULL,
+	NUM_BATT_STATUS
+} battery_status_t;
+
+static const char *const battery_status_names[NUM_BATT_STATUS] =
+{
+	[BATT_STATUS_UNKNOWN]       = "Unknown",
+	[BATT_STATUS_CHARGING]      = "Charging",
+	[BATT_STATUS_DISCHARGING]   = "Discharging",
+	[BATT_STATUS_NOT_CHARGING]  = "Not charging",
+	[BATT_STATUS_FULL]          = "Full",
+};
+
+static battery_status_t battery_status = BATT_STATUS_UNKNOWN;
+
+static sysfs_attr_t batt_present_attr = SYSFS_ATTR_INIT;
+static sysfs_attr_t batt_status_attr = SYSFS_ATTR_INIT;
+
+/* Charger supplies whose online state is tracked */
+typedef enum
+{
+	CHARGER_USB = 0,
+	CHARGER_AC,
+	CHARGER_TOUCH,
+	CHARGER_WIRELESS,
+	NUM_CHARGER_TYPES
+} charger_type_t;
+
+/* power_supply type of each charger */
+static const char *charger_supply_types[NUM_CHARGER_TYPES] =
+{
+	[CHARGER_USB]       = "USB",
+	[CHARGER_AC]        = "Mains",
+	[CHARGER_TOUCH]     = "Touch",
+	[CHARGER_WIRELESS]  = "Wireless",
+};
+
+/* online attribute of each charger, closed for missing chargers */
+static sysfs_attr_t charger_online_attrs[NUM_CHARGER_TYPES] =
+{
+	SYSFS_ATTR_INIT, SYSFS_ATTR_INIT, SYSFS_ATTR_INIT, SYSFS_ATTR_INIT
+};
+
+/* last online value of each charger, -1 if unknown */
+static int charger_online[NUM_CHARGER_TYPES] = { -1, -1, -1, -1 };
 
 static nyx_charger_event_t current_event = NYX_NO_NEW_EVENT;
 nyx_charger_status_t gChargerStatus =
@@ -69,29 +107,63 @@ nyx_charger_status_t gChargerStatus =
 	.is_charging = 0,
 };
 
-nyx_error_t _charger_read_status(nyx_charger_status_t *status)
+/**
+ * @brief Rebuild the charger status from the cached online values
+ */
+static void _charger_update_status(void)
 {
+	int i;
+
 	/* before we start to update the charger status we reset it completely */
 	memset(&gChargerStatus, 0, sizeof(nyx_charger_status_t));
 
-	/* function returns -1 on invalid file path, so check for 1, instead of true */
-	if (nyx_utils_read_value(charger_usb_sysfs_online_path) == 1)
+	/* online is -1 for unknown chargers, so check for 1, instead of true */
+	if (charger_online[CHARGER_USB] == 1)
 	{
 		gChargerStatus.connected |= NYX_CHARGER_PC_CONNECTED;
 		gChargerStatus.powered |= NYX_CHARGER_USB_POWERED;
 	}
-	else if (nyx_utils_read_value(charger_ac_sysfs_online_path) == 1)
+	else if (charger_online[CHARGER_AC] == 1)
 	{
 		gChargerStatus.connected |= NYX_CHARGER_WALL_CONNECTED;
 		gChargerStatus.powered |= NYX_CHARGER_DIRECT_POWERED;
 	}
 
-	if ((nyx_utils_read_value(charger_usb_sysfs_online_path) == 1) || (nyx_utils_read_value(charger_ac_sysfs_online_path) == 1) ||
-	    (nyx_utils_read_value(charger_touch_sysfs_online_path) == 1) || (nyx_utils_read_value(charger_wireless_sysfs_online_path) == 1))
+	for (i = 0; i < NUM_CHARGER_TYPES; i++)
+	{
+		if (charger_online[i] == 1)
+		{
+			gChargerStatus.is_charging = 1;
+		}
+	}
+}
+
+/**
+ * @brief Read the online attribute of a charger, -1 if missing
+ */
+static int _charger_read_online(charger_type_t type)
+{
+	long online;
+
+	if (sysfs_attr_read_int(&charger_online_attrs[type], &online) < 0)
+	{
+		return -1;
+	}
+
+	return (int) online;
+}
+
+nyx_error_t _charger_read_status(nyx_charger_status_t *status)
+{
+	int i;
+
+	for (i = 0; i < NUM_CHARGER_TYPES; i++)
 	{
-		gChargerStatus.is_charging = 1;
+		charger_online[i] = _charger_read_online(i);
 	}
 
+	_charger_update_status();
+
 	if (status)
 	{
 		memcpy(status, &gChargerStatus, sizeof(nyx_charger_status_t));
@@ -100,23 +172,40 @@ nyx_error_t _charger_read_status(nyx_charger_status_t *status)
 	return NYX_ERROR_NONE;
 }
 
+static void _battery_read_present(void)
+{
+	long present;
+
+	curr_battery_state->present = (sysfs_attr_read_int(&batt_present_attr, &present) == 0) &&
+	                              (present == 1);
+}
+
+/**
+ * @brief Map a power_supply status text, unknown values being BATT_STATUS_UNKNOWN
+ */
+static battery_status_t _battery_parse_status(const char *text)
+{
+	int status = sysfs_parse_enum(text, battery_status_names, NUM_BATT_STATUS);
+
+	return (status < 0) ? BATT_STATUS_UNKNOWN : (battery_status_t) status;
+}
+
+static void _battery_read_status_value(void)
+{
+	int status = sysfs_attr_read_enum(&batt_status_attr, battery_status_names,
+	                                  NUM_BATT_STATUS);
+
+	battery_status = (status < 0) ? BATT_STATUS_UNKNOWN : (battery_status_t) status;
+}
+
 bool _battery_read_status()
 {
-	if (curr_battery_state && battery_status)
+	if (curr_battery_state)
 	{
 		memset(curr_battery_state, 0, sizeof(nyx_battery_status_t));
-		memset(battery_status, 0, sizeof(battery_status));
-		char* status = (char*)malloc(STATUS_LEN);
-
-		if (g_file_test(batt_present_path, G_FILE_TEST_EXISTS))
-	    	{
-			curr_battery_state->present = ((nyx_utils_read_value(batt_present_path)) == 1) ? true : false;
-	    	}
-		if ((g_file_test(batt_status_path, G_FILE_TEST_EXISTS)) && (FileGetString(batt_status_path, status, STATUS_LEN)!=-1))
-		{
-			strcpy(battery_status,status);
-		}
-		free(status);
+		_battery_read_present();
+		_battery_read_status_value();
+		return true;
 	}
 	else
 	{
@@ -124,23 +213,92 @@ bool _battery_read_status()
 	}
 }
 
-bool _has_charger_state_changed(char* old_state, char* new_state)
+/**
+ * @brief Update the charger and battery state from a power_supply uevent
+ *
+ * Only the supply that sent the event is updated, from the POWER_SUPPLY_*
+ * properties the kernel attaches to it. Sysfs is read for properties the
+ * event lacks, and in full for events of unknown supplies.
+ */
+static void _read_event_status(const power_supply_t *supply)
+{
+	int i;
+
+	if (supply->type[0] == '\0')
+	{
+		_charger_read_status(NULL);
+		_battery_read_status();
+		return;
+	}
+
+	if (power_supply_is_type(supply, "Battery"))
+	{
+		if (supply->removed)
+		{
+			curr_battery_state->present = false;
+			battery_status = BATT_STATUS_UNKNOWN;
+			return;
+		}
+
+		if (power_supply_has(supply, PS_PROP_PRESENT))
+		{
+			curr_battery_state->present = (supply->values[PS_PROP_PRESENT] == 1);
+		}
+		else
+		{
+			_battery_read_present();
+		}
+
+		if (power_supply_has(supply, PS_PROP_STATUS))
+		{
+			battery_status = _battery_parse_status(supply->status);
+		}
+		else
+		{
+			_battery_read_status_value();
+		}
+		return;
+	}
+
+	for (i = 0; i < NUM_CHARGER_TYPES; i++)
+	{
+		if (power_supply_is_type(supply, charger_supply_types[i]))
+		{
+			if (supply->removed)
+			{
+				charger_online[i] = 0;
+			}
+			else if (power_supply_has(supply, PS_PROP_ONLINE))
+			{
+				charger_online[i] = supply->values[PS_PROP_ONLINE];
+			}
+			else
+			{
+				charger_online[i] = _charger_read_online(i);
+			}
+			_charger_update_status();
+			return;
+		}
+	}
+}
+
+bool _has_charger_state_changed(battery_status_t old_state, battery_status_t new_state)
 {
-	if (new_state && !old_state && (strcmp(new_state, "Full") == 0))
+	if ((old_state == BATT_STATUS_NONE) && (new_state == BATT_STATUS_FULL))
 	{
 		current_event &= ~NYX_CHARGE_RESTART;
 		current_event |= NYX_CHARGE_COMPLETE;
 		return true;
 	}
 
-	if (old_state && new_state && (strcmp(old_state,new_state) != 0))
+	if ((old_state != BATT_STATUS_NONE) && (old_state != new_state))
 	{
-		if ((strcmp(old_state, "Charging") == 0) && (strcmp(new_state, "Full") == 0))
+		if ((old_state == BATT_STATUS_CHARGING) && (new_state == BATT_STATUS_FULL))
 		{
 			current_event &= ~NYX_CHARGE_RESTART;
 			current_event |= NYX_CHARGE_COMPLETE;
 		}
-		else if ((strcmp(old_state, "Full") == 0) && (strcmp(new_state, "Charging") == 0))
+		else if ((old_state == BATT_STATUS_FULL) && (new_state == BATT_STATUS_CHARGING))
 		{
 			current_event &= ~NYX_CHARGE_COMPLETE;
 			current_event |= NYX_CHARGE_RESTART;
@@ -201,146 +359,101 @@ bool _has_charger_connected_state_changed(bool old_state, bool new_state)
 	}
 }
 
-gboolean _handle_power_supply_event(GIOChannel *channel, GIOCondition condition, gpointer data)
+void _detect_charger_sysfs_paths()
 {
-	struct udev_device *dev;
-	bool fire_charger_status_cb = false;
-	bool fire_state_change_cb = false;
+	const char *battery_sysfs_path = find_power_supply_sysfs_path("Battery");
+	int i;
 
-	if ((condition & G_IO_IN) == G_IO_IN)
+	for (i = 0; i < NUM_CHARGER_TYPES; i++)
 	{
-		dev = udev_monitor_receive_device(mon);
-		if (dev)
-		{
-			/* something related to power supply has changed; set the modified event and notify connected clients so
-			 * they can query the new status */
-
-			/* Check for event changes and initiate state callback for particular events as below:
-			 * NYX_CHARGE_COMPLETE if battery/status from NULL/Charging to Full, NYX_CHARGE_RESTART if battery/status from Full to Charging,
-			 * NYX_CHARGER_CONNECTED if USB,AC or any other charger online is from 0 to 1,
-			 * NYX_CHARGER_DISCONNECTED if any charger online from 1 to 0,
-			 * NYX_CHARGER_FAULT if online=1 and battery/status=Not Charging/Discharging? - TODO: not implemented since we are not sure of the state change for this event
-			 * NYX_BATTERY_PRESENT if battery is present (0-1)
-			 * NYX_BATTERY_ABSENT if battery is absent (1-0)
-			 * NYX_BATTERY_CRITICAL_VOLTAGE if Battery voltage below threshold - TODO: not implemented since we do not get kobject for voltage changes
-			 * NYX_BATTERY_TEMPERATURE_LIMIT if Battery temperature below/above limits - TODO: not implemented since we do not get kobject for temperature changes
-			 */
-
-			bool prev_charging = gChargerStatus.is_charging;
-			_charger_read_status(NULL);
-			if (_has_charger_connected_state_changed(prev_charging, gChargerStatus.is_charging))
-			{
-				fire_charger_status_cb = true;
-				fire_state_change_cb = true;
-			}
-
-			/* Keep a note of previous values */
-			char* prev_batt_status = g_strdup(battery_status);
-			int prev_batt_present = curr_battery_state->present;
-
-			_battery_read_status();
-			if ((_has_charger_state_changed(prev_batt_status, battery_status)) || (_has_battery_state_changed(prev_batt_present,curr_battery_state->present)))
-			{
-				fire_state_change_cb = true;
-			}
-			g_free(prev_batt_status);
-
-			if (fire_charger_status_cb && charger_status_callback)
-			{
-				charger_status_callback(nyxDev, NYX_CALLBACK_STATUS_DONE, charger_status_callback_context);
-				fire_charger_status_cb = false;
-			}
-			if (fire_state_change_cb && state_change_callback)
-			{
-				state_change_callback(nyxDev, NYX_CALLBACK_STATUS_DONE, state_change_callback_context);
-				fire_state_change_cb = false;
-			}
-		}
+		sysfs_attr_open(&charger_online_attrs[i],
+		                find_power_supply_sysfs_path(charger_supply_types[i]), "online");
 	}
-	return TRUE;
-}
 
-void _charger_init_events()
-{
-	_has_charger_state_changed(NULL, battery_status);
-	_has_battery_state_changed(0, curr_battery_state->present);
-	_has_charger_connected_state_changed(0, gChargerStatus.is_charging);
+	sysfs_attr_open(&batt_present_attr, battery_sysfs_path, "present");
+	sysfs_attr_open(&batt_status_attr, battery_sysfs_path, "status");
 }
 
-void _detect_charger_sysfs_paths()
+static void _handle_power_supply_event(const power_supply_t *supply, void *context)
 {
-	char* battery_sysfs_path = find_power_supply_sysfs_path("Battery");
-	char* charger_usb_sysfs_path = find_power_supply_sysfs_path("USB");
-	char* charger_ac_sysfs_path = find_power_supply_sysfs_path("Mains");
-	char* charger_touch_sysfs_path = find_power_supply_sysfs_path("Touch");
-	char* charger_wireless_sysfs_path = find_power_supply_sysfs_path("Wireless");
+	bool fire_charger_status_cb = false;
+	bool fire_state_change_cb = false;
 
-	if (charger_usb_sysfs_path)
-	{
-		snprintf (charger_usb_sysfs_online_path, PATH_LEN, "%s/online", charger_usb_sysfs_path);
-	}
-	if (charger_ac_sysfs_path)
-	{
-		snprintf (charger_ac_sysfs_online_path, PATH_LEN, "%s/online", charger_ac_sysfs_path);
-	}
-	if (charger_touch_sysfs_path)
-	{
-		snprintf (charger_touch_sysfs_online_path, PATH_LEN, "%s/online", charger_touch_sysfs_path);
-	}
-	if (charger_wireless_sysfs_path)
+	/* something related to power supply has changed; set the modified event and notify connected clients so
+	 * they can query the new status */
+
+	/* Check for event changes and initiate state callback for particular events as below:
+	 * NYX_CHARGE_COMPLETE if battery/status from NULL/Charging to Full, NYX_CHARGE_RESTART if battery/status from Full to Charging,
+	 * NYX_CHARGER_CONNECTED if USB,AC or any other charger online is from 0 to 1,
+	 * NYX_CHARGER_DISCONNECTED if any charger online from 1 to 0,
+	 * NYX_CHARGER_FAULT if online=1 and battery/status=Not Charging/Discharging? - TODO: not implemented since we are not sure of the state change for this event
+	 * NYX_BATTERY_PRESENT if battery is present (0-1)
+	 * NYX_BATTERY_ABSENT if battery is absent (1-0)
+	 * NYX_BATTERY_CRITICAL_VOLTAGE if Battery voltage below threshold - TODO: not implemented since we do not get kobject for voltage changes
+	 * NYX_BATTERY_TEMPERATURE_LIMIT if Battery temperature below/above limits - TODO: not implemented since we do not get kobject for temperature changes
+	 */
+
+	/* Keep a note of previous values */
+	bool prev_charging = gChargerStatus.is_charging;
+	battery_status_t prev_batt_status = battery_status;
+	int prev_batt_present = curr_battery_state->present;
+
+	/* a supply came or went; take the sysfs paths from the updated index */
+	if (power_supply_index_update(supply->name, supply->type, supply->removed))
 	{
-		snprintf (charger_wireless_sysfs_online_path, PATH_LEN, "%s/online", charger_wireless_sysfs_path);
+		_detect_charger_sysfs_paths();
 	}
-	if (battery_sysfs_path)
-	{
-		snprintf (batt_present_path, PATH_LEN, "%s/present", battery_sysfs_path);
-		snprintf (batt_status_path, PATH_LEN, "%s/status", battery_sysfs_path);
-	}
-}
 
-nyx_error_t _charger_init(void)
-{
-	int fd;
+	_read_event_status(supply);
 
-	udev = udev_new();
-	if (!udev)
+	if (_has_charger_connected_state_changed(prev_charging, gChargerStatus.is_charging))
 	{
-		nyx_error("Could not initialize udev component; charger status updates will not be available");
-		return NYX_ERROR_GENERIC;
+		fire_charger_status_cb = true;
+		fire_state_change_cb = true;
 	}
 
-	mon = udev_monitor_new_from_netlink(udev, "kernel");
-	if (mon == NULL)
+	if ((_has_charger_state_changed(prev_batt_status, battery_status)) || (_has_battery_state_changed(prev_batt_present,curr_battery_state->present)))
 	{
-		nyx_error("Failed to create udev monitor for kernel events");
-		return NYX_ERROR_GENERIC;
+		fire_state_change_cb = true;
 	}
-	if (udev_monitor_filter_add_match_subsystem_devtype(mon, "power_supply", NULL) < 0)
+
+	if (fire_charger_status_cb && charger_status_callback)
 	{
-		nyx_error("Failed to setup udev filter for power_supply subsytem events");
-		return NYX_ERROR_GENERIC;
+		charger_status_callback(nyxDev, NYX_CALLBACK_STATUS_DONE, charger_status_callback_context);
+		fire_charger_status_cb = false;
 	}
-	if (udev_monitor_enable_receiving(mon) < 0)
+	if (fire_state_change_cb && state_change_callback)
 	{
-		nyx_error("Failed to enable receiving kernel events for power_supply subsytem\n");
-		return NYX_ERROR_GENERIC;
+		state_change_callback(nyxDev, NYX_CALLBACK_STATUS_DONE, state_change_callback_context);
+		fire_state_change_cb = false;
 	}
-	fd = udev_monitor_get_fd(mon);
+}
+
+void _charger_init_events()
+{
+	_has_charger_state_changed(BATT_STATUS_NONE, battery_status);
+	_has_battery_state_changed(0, curr_battery_state->present);
+	_has_charger_connected_state_changed(0, gChargerStatus.is_charging);
+}
 
+nyx_error_t _charger_init(void)
+{
 	/* Initialize charger sysfs paths */
 	_detect_charger_sysfs_paths();
 	/* Initialize battery and charger status */
 	_charger_read_status(NULL);
 	curr_battery_state = (nyx_battery_status_t *) malloc(sizeof(nyx_battery_status_t));
-	battery_status = (char *)malloc(STATUS_LEN);
 	_battery_read_status();
 
 	/* Initialize events */
 	_charger_init_events();
 
-	/* Setup io watch for uevents */
-	channel = g_io_channel_unix_new(fd);
-	g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_NVAL, _handle_power_supply_event, NULL);
+	/* Subscribe to power_supply uevents */
+	if (power_supply_hub_subscribe(_handle_power_supply_event, NULL) < 0)
+	{
+		nyx_error("Charger status updates will not be available");
+		return NYX_ERROR_GENERIC;
+	}
 
 	return NYX_ERROR_NONE;
 }
@@ -26,9 +26,20 @@
 #include <poll.h>
 #include <glib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <libudev.h>
 
 #include <nyx/nyx_module.h>
 
+#include "latency.h"
+#include "input_reader.h"
+#include "keys_keymap.h"
+#include "keys_combo.h"
+
 enum
 {
     F1 = 0x276C, /* Function keys */
@@ -45,15 +56,9 @@ enum
     KEY_ORANGE = 0x64
 };
 
-int keypad_event_fd;
-
-typedef struct
-{
-	nyx_device_t _parent;
-	nyx_event_keys_t *current_event_ptr;
-} keys_device_t;
-
-NYX_DECLARE_MODULE(NYX_DEVICE_KEYS, "Keys");
+#ifndef KEYS_KEYMAP_FILE
+#define KEYS_KEYMAP_FILE "/etc/nyx/keymap.bin"
+#endif
 
 /**
  * This is modeled after the linux input event interface events.
@@ -67,11 +72,117 @@ typedef struct InputEvent
 	int32_t value;        /**< event value: coordinate, intensity,etc. */
 } InputEvent_t;
 
+#define MAX_EVENTS      64
+
+/* Event nodes watched at the same time */
+#define MAX_KEY_SOURCES 8
+
+/* epoll tags of the udev monitor and the timers, sources are tagged
+ * with their index */
+#define HOTPLUG_TAG     MAX_KEY_SOURCES
+#define REPEAT_TAG      (MAX_KEY_SOURCES + 1)
+#define COMBO_TAG       (MAX_KEY_SOURCES + 2)
+
+/* Autorepeat of standard and custom keys, 0 turns it off */
+#ifndef KEYS_REPEAT_DELAY_MS
+#define KEYS_REPEAT_DELAY_MS            500
+#endif
+
+#ifndef KEYS_REPEAT_PERIOD_MS
+#define KEYS_REPEAT_PERIOD_MS           33
+#endif
+
+#ifndef KEYS_CUSTOM_REPEAT_DELAY_MS
+#define KEYS_CUSTOM_REPEAT_DELAY_MS     400
+#endif
+
+#ifndef KEYS_CUSTOM_REPEAT_PERIOD_MS
+#define KEYS_CUSTOM_REPEAT_PERIOD_MS    100
+#endif
+
+/* Values of keys_set_repeat() */
+typedef enum
+{
+    KEY_REPEAT_STANDARD = 0,        /**< keys reported as NYX_KEY_TYPE_STANDARD */
+    KEY_REPEAT_CUSTOM,              /**< keys reported as NYX_KEY_TYPE_CUSTOM */
+    KEY_REPEAT_NUM_CLASSES
+} key_repeat_class_t;
+
+typedef struct
+{
+	unsigned int delay_ms;          /**< hold time before the first repeat */
+	unsigned int period_ms;         /**< time between repeats */
+} key_repeat_t;
+
+#define BITS_PER_LONG           (sizeof(unsigned long) * 8)
+#define NBITS(x)                ((((x) - 1) / BITS_PER_LONG) + 1)
+#define TEST_BIT(bit, array)    ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+/**
+ * An event node feeding the module. Each node is resynced on its own after
+ * a drop, so it keeps the state of its keys.
+ */
+typedef struct
+{
+	int fd;                         /**< -1 once closed */
+	dev_t rdev;                     /**< device number, to spot duplicates */
+	clockid_t clock;                /**< clock the node stamps events with */
+	bool removed;                   /**< unplugged, releasing its keys */
+	InputEvent_t raw_events[MAX_EVENTS];    /**< events of the last read */
+	int event_count;
+	int event_iter;                 /**< next raw event to deliver */
+	unsigned long key_state[NBITS(KEY_CNT)];    /**< keys down on this node */
+	unsigned long resync_state[NBITS(KEY_CNT)]; /**< state read back after a drop */
+	bool resync_pending;            /**< input dropped, skipping to SYN_REPORT */
+	bool resyncing;                 /**< reporting the difference to resync_state */
+	int resync_next;                /**< next key code to compare */
+} key_source_t;
+
+typedef struct
+{
+	nyx_device_t _parent;
+	latency_histogram_t latency;    /**< kernel event to delivery latency, only
+	                                     touched by the caller's thread */
+	bool threaded;                  /**< events are produced by the reader */
+	input_reader_t reader;
+	int epoll_fd;                   /**< watches every node and the monitor */
+	key_source_t sources[MAX_KEY_SOURCES];
+	struct udev *udev;
+	struct udev_monitor *monitor;   /**< input hotplug, NULL if unavailable */
+	unsigned long key_state[NBITS(KEY_CNT)];    /**< keys down on any node */
+	unsigned int syn_dropped;       /**< kernel buffer overruns seen */
+	keymap_t keymap;                /**< key codes to reported keys */
+	int repeat_fd;                  /**< timerfd ticking while a key repeats */
+	key_repeat_t repeat[KEY_REPEAT_NUM_CLASSES];    /**< accessed atomically */
+	int repeat_code;                /**< key being repeated, -1 if none */
+	bool repeat_due;                /**< the timer ticked since the last repeat */
+	int combo_fd;                   /**< timerfd of the next long press */
+	int64_t combo_deadline;         /**< ns the timer is set to, 0 if disarmed */
+	key_combo_state_t combos;
+	bool combos_only;               /**< only combinations are reported,
+	                                     accessed atomically */
+} keys_device_t;
+
+NYX_DECLARE_MODULE(NYX_DEVICE_KEYS, "Keys");
+
+/**
+ * Key event as allocated by the module, with the kernel time of the input
+ * event it reports. Repeats, combinations and resynced keys have none.
+ */
+typedef struct
+{
+	nyx_event_keys_t event;
+	struct timeval kernel_time;
+	clockid_t kernel_clock;         /**< clock of kernel_time */
+	bool has_kernel_time;
+} key_event_t;
+
+#define KEY_EVENT(event_ptr)    ((key_event_t *) (event_ptr))
 
 static nyx_event_keys_t *keys_event_create()
 {
 	nyx_event_keys_t *event_ptr = (nyx_event_keys_t *) calloc(
-	                                  sizeof(nyx_event_keys_t), 1);
+	                                  sizeof(key_event_t), 1);
 
 	if (NULL == event_ptr)
 	{
@@ -101,307 +212,1149 @@ nyx_error_t keys_release_event(nyx_device_t *d, nyx_event_t *e)
 	return NYX_ERROR_NONE;
 }
 
-static int
-init_keypad(void)
+/**
+ * Read the keys that are down from an event node, false if it can't tell
+ */
+static bool
+query_key_state(int fd, unsigned long *state)
 {
-#ifdef KEYPAD_INPUT_DEVICE
-	keypad_event_fd = open(KEYPAD_INPUT_DEVICE, O_RDWR);
+	memset(state, 0, sizeof(unsigned long) * NBITS(KEY_CNT));
 
-	if (keypad_event_fd < 0)
+	return ioctl(fd, EVIOCGKEY(sizeof(unsigned long) * NBITS(KEY_CNT)),
+	             state) >= 0;
+}
+
+/* Keys that never repeat */
+static bool
+key_repeats(uint16_t code)
+{
+	switch (code)
 	{
-		nyx_error("Error in opening keypad event file");
-		return -1;
-	}
+		case KEY_LEFTSHIFT:
+		case KEY_RIGHTSHIFT:
+		case KEY_LEFTCTRL:
+		case KEY_RIGHTCTRL:
+		case KEY_LEFTALT:
+		case KEY_RIGHTALT:
+		case KEY_LEFTMETA:
+		case KEY_RIGHTMETA:
+		case KEY_CAPSLOCK:
+		case KEY_END:
+		case KEY_POWER:
+			return false;
 
-	return 0;
-#else
-	return -1;
-#endif
+		default:
+			return true;
+	}
 }
 
-nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
+/**
+ * Start repeating the key just pressed, or stop when the repeating key is
+ * released. Like the kernel, only the last key pressed repeats. The timer
+ * only runs while a key is held, so an idle device is not woken up.
+ */
+static void
+update_repeat(keys_device_t *keys_device, uint16_t code, bool down)
 {
-	keys_device_t *keys_device = (keys_device_t *) calloc(sizeof(keys_device_t),
-	                             1);
+	struct itimerspec spec;
+	key_repeat_t *repeat;
+	unsigned int delay_ms, period_ms;
+	nyx_key_type_t type;
 
-	if (G_UNLIKELY(!keys_device))
+	if (!down && code != keys_device->repeat_code)
 	{
-		return NYX_ERROR_OUT_OF_MEMORY;
+		return;
 	}
 
-	init_keypad();
+	if (__atomic_load_n(&keys_device->combos_only, __ATOMIC_RELAXED))
+	{
+		down = false;
+	}
 
-	nyx_module_register_method(i, (nyx_device_t *) keys_device,
-	                           NYX_GET_EVENT_SOURCE_MODULE_METHOD, "keys_get_event_source");
-	nyx_module_register_method(i, (nyx_device_t *) keys_device,
-	                           NYX_GET_EVENT_MODULE_METHOD, "keys_get_event");
-	nyx_module_register_method(i, (nyx_device_t *) keys_device,
-	                           NYX_RELEASE_EVENT_MODULE_METHOD, "keys_release_event");
+	memset(&spec, 0, sizeof(spec));
+	keys_device->repeat_code = -1;
+	keys_device->repeat_due = false;
 
-	*d = (nyx_device_t *) keys_device;
+	if (down && key_repeats(code))
+	{
+		keymap_lookup(&keys_device->keymap, code, &type);
+		repeat = &keys_device->repeat[(NYX_KEY_TYPE_CUSTOM == type) ?
+		                              KEY_REPEAT_CUSTOM : KEY_REPEAT_STANDARD];
 
-	return NYX_ERROR_NONE;
+		/* set by keys_set_repeat() from the caller's thread */
+		delay_ms = __atomic_load_n(&repeat->delay_ms, __ATOMIC_RELAXED);
+		period_ms = __atomic_load_n(&repeat->period_ms, __ATOMIC_RELAXED);
 
-fail_unlock_settings:
+		if (delay_ms > 0 && period_ms > 0)
+		{
+			spec.it_value.tv_sec = delay_ms / 1000;
+			spec.it_value.tv_nsec = (delay_ms % 1000) * 1000000L;
+			spec.it_interval.tv_sec = period_ms / 1000;
+			spec.it_interval.tv_nsec = (period_ms % 1000) * 1000000L;
+			keys_device->repeat_code = code;
+		}
+	}
 
-	return NYX_ERROR_GENERIC;
+	if (keys_device->repeat_fd >= 0 &&
+	        timerfd_settime(keys_device->repeat_fd, 0, &spec, NULL) < 0)
+	{
+		nyx_error("Failed to set the key repeat timer");
+	}
 }
 
-nyx_error_t nyx_module_close(nyx_device_t *d)
+/**
+ * Match the combinations against the keys now down and set the timer for
+ * the next one that fires after a hold, unless it is already set for it
+ */
+static void
+update_combos(keys_device_t *keys_device)
 {
-	keys_device_t *keys_device = (keys_device_t *) d;
+	struct itimerspec spec;
+	struct timespec now;
+	int64_t next;
 
-	if (NULL == d)
-	{
-		return NYX_ERROR_INVALID_HANDLE;
-	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	next = key_combo_update(&keys_device->combos, keys_device->key_state,
+	                        now.tv_sec * 1000000000LL + now.tv_nsec);
 
-	if (keys_device->current_event_ptr)
+	if (next == keys_device->combo_deadline)
 	{
-		keys_release_event(d, (nyx_event_t *) keys_device->current_event_ptr);
+		return;
 	}
 
-	nyx_debug("Freeing keys %p", d);
-	free(d);
+	keys_device->combo_deadline = next;
 
-	return NYX_ERROR_NONE;
+	memset(&spec, 0, sizeof(spec));
+	spec.it_value.tv_sec = next / 1000000000LL;
+	spec.it_value.tv_nsec = next % 1000000000LL;
+
+	if (keys_device->combo_fd >= 0 &&
+	        timerfd_settime(keys_device->combo_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+	{
+		nyx_error("Failed to set the key combination timer");
+	}
 }
 
-nyx_error_t keys_get_event_source(nyx_device_t *d, int *f)
+/**
+ * The reader thread updates the state while callers may query it. A key
+ * stays down as long as any node holds it.
+ */
+static void
+set_key_state(keys_device_t *keys_device, key_source_t *source, uint16_t code,
+              bool down)
 {
-	if (NULL == d)
+	unsigned long mask = 1UL << (code % BITS_PER_LONG);
+	int index = code / BITS_PER_LONG;
+	unsigned long held = 0;
+	int i;
+
+	if (down)
 	{
-		return NYX_ERROR_INVALID_HANDLE;
+		source->key_state[index] |= mask;
+		__atomic_fetch_or(&keys_device->key_state[index], mask, __ATOMIC_RELAXED);
 	}
-
-	if (NULL == f)
+	else
 	{
-		return NYX_ERROR_INVALID_VALUE;
+		source->key_state[index] &= ~mask;
+
+		for (i = 0; i < MAX_KEY_SOURCES; i++)
+		{
+			held |= keys_device->sources[i].key_state[index];
+		}
+
+		__atomic_store_n(&keys_device->key_state[index], held, __ATOMIC_RELAXED);
 	}
 
-	*f = keypad_event_fd;
+	update_repeat(keys_device, code, down);
 
-	return NYX_ERROR_NONE;
+	if (key_combo_uses(&keys_device->combos, code))
+	{
+		update_combos(keys_device);
+	}
 }
 
-static int lookup_key(keys_device_t *d, uint16_t keyCode, int32_t keyValue,
-                      nyx_key_type_t *key_type_out_ptr)
+/**
+ * Open an event node and add it to the epoll set. Nodes already watched,
+ * such as KEYPAD_INPUT_DEVICE showing up again through udev, are skipped.
+ */
+static int
+add_key_source(keys_device_t *keys_device, const char *path)
 {
-	int key = 0;
-
-	switch (keyCode)
-	{
-		case KEY_HOME:
-			key = NYX_KEYS_CUSTOM_KEY_HOME;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	struct epoll_event ev;
+	key_source_t *source = NULL;
+	struct stat st;
+	int fd, i, free_slot = -1;
 
-		case KEY_VOLUMEUP:
-			key = NYX_KEYS_CUSTOM_KEY_VOL_UP;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
 
-		case KEY_VOLUMEDOWN:
-			key = NYX_KEYS_CUSTOM_KEY_VOL_DOWN;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	if (fd < 0 || fstat(fd, &st) < 0)
+	{
+		nyx_error("Error in opening key event file %s", path);
+		goto error;
+	}
 
-		case KEY_END:
-			key = NYX_KEYS_CUSTOM_KEY_POWER_ON;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	for (i = 0; i < MAX_KEY_SOURCES; i++)
+	{
+		source = &keys_device->sources[i];
 
-		case KEY_PLAY:
-			key = NYX_KEYS_CUSTOM_KEY_MEDIA_PLAY;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+		if (source->fd >= 0 && source->rdev == st.st_rdev)
+		{
+			close(fd);
+			return 0;
+		}
 
-		case KEY_PAUSE:
-			key = NYX_KEYS_CUSTOM_KEY_MEDIA_PAUSE;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+		if (free_slot < 0 && source->fd < 0 && !source->removed)
+		{
+			free_slot = i;
+		}
+	}
 
-		case KEY_STOP:
-			key = NYX_KEYS_CUSTOM_KEY_MEDIA_STOP;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	if (free_slot < 0)
+	{
+		nyx_warn("Too many key event files, ignoring %s", path);
+		goto error;
+	}
 
-		case KEY_NEXT:
-			key = NYX_KEYS_CUSTOM_KEY_MEDIA_NEXT;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	source = &keys_device->sources[free_slot];
+	memset(source, 0, sizeof(*source));
+	source->fd = fd;
+	source->rdev = st.st_rdev;
 
-		case KEY_PREVIOUS:
-			key = NYX_KEYS_CUSTOM_KEY_MEDIA_PREVIOUS;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	ev.events = EPOLLIN;
+	ev.data.u32 = free_slot;
 
-			// add keyboard function keys
-		case KEY_SEARCH:
-			key = NYX_KEYS_CUSTOM_KEY_SEARCH;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	if (epoll_ctl(keys_device->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		nyx_error("Failed to watch key event file %s", path);
+		source->fd = -1;
+		goto error;
+	}
 
-		case KEY_BRIGHTNESSDOWN:
-			key = NYX_KEYS_CUSTOM_KEY_BRIGHTNESS_DOWN;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	source->clock = input_set_monotonic_clock(fd);
 
-		case KEY_BRIGHTNESSUP:
-			key = NYX_KEYS_CUSTOM_KEY_BRIGHTNESS_UP;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	/* keys held down while opening are released later on */
+	query_key_state(fd, source->key_state);
 
-		case KEY_MUTE:
-			key = NYX_KEYS_CUSTOM_KEY_VOL_MUTE;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	for (i = 0; i < NBITS(KEY_CNT); i++)
+	{
+		__atomic_fetch_or(&keys_device->key_state[i], source->key_state[i],
+		                  __ATOMIC_RELAXED);
+	}
 
-		case KEY_REWIND:
-			key = NYX_KEYS_CUSTOM_KEY_MEDIA_REWIND;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	nyx_debug("Watching key event file %s", path);
 
-		case KEY_FASTFORWARD:
-			key = NYX_KEYS_CUSTOM_KEY_MEDIA_FASTFORWARD;
-			*key_type_out_ptr = NYX_KEY_TYPE_CUSTOM;
-			break;
+	return 0;
 
-		default:
-			break;
-	}
+error:
 
-	if (*key_type_out_ptr != NYX_KEY_TYPE_CUSTOM)
+	if (fd >= 0)
 	{
-		if (keyCode == KEY_LEFTSHIFT)
-		{
-			key = KEY_LEFTSHIFT;
-		}
-		else
-		{
-			key = keyCode;
-		}
+		close(fd);
 	}
 
-	return key;
+	return -1;
 }
 
-struct pollfd fds[1];
+/**
+ * Stop watching a node that went away. Its unread input is dropped and the
+ * keys still down on it are released before the slot is reused.
+ */
+static void
+remove_key_source(keys_device_t *keys_device, key_source_t *source)
+{
+	epoll_ctl(keys_device->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+	close(source->fd);
+
+	source->fd = -1;
+	source->removed = true;
+	source->event_count = 0;
+	source->event_iter = 0;
+	source->resync_pending = false;
+	source->resyncing = true;
+	source->resync_next = 0;
+	memset(source->resync_state, 0, sizeof(source->resync_state));
+}
 
-int
-read_input_event(InputEvent_t *pEvents, int maxEvents)
+/**
+ * Join keyboards as they are plugged in and let them go when unplugged
+ */
+static void
+handle_hotplug(keys_device_t *keys_device)
 {
-	int numEvents = 0;
-	int rd = 0;
+	struct udev_device *dev = udev_monitor_receive_device(keys_device->monitor);
+	const char *action, *devnode, *is_key;
+	dev_t devnum;
+	int i;
 
-	if (pEvents == NULL)
+	if (NULL == dev)
 	{
-		return -1;
+		return;
 	}
 
-	fds[0].fd = keypad_event_fd;
-	fds[0].events = POLLIN;
+	action = udev_device_get_action(dev);
+	devnode = udev_device_get_devnode(dev);
+	is_key = udev_device_get_property_value(dev, "ID_INPUT_KEY");
 
-	int ret_val = poll(fds, 1, 0);
-
-	if (ret_val <= 0)
+	if (NULL == action || NULL == devnode ||
+	        strncmp(devnode, "/dev/input/event", 16) != 0)
 	{
-		return 0;
+		udev_device_unref(dev);
+		return;
 	}
 
-	if (fds[0].revents & POLLIN)
+	if (strcmp(action, "add") == 0 && is_key && strcmp(is_key, "1") == 0)
 	{
-		/* keep looping if get EINTR */
-		for (;;)
-		{
-			rd = read(fds[0].fd, pEvents, sizeof(InputEvent_t) * maxEvents);
+		add_key_source(keys_device, devnode);
+	}
+	else if (strcmp(action, "remove") == 0)
+	{
+		devnum = udev_device_get_devnum(dev);
 
-			if (rd > 0)
-			{
-				numEvents += rd / sizeof(InputEvent_t);
-				break;
-			}
-			else if (rd < 0 && errno != EINTR)
+		for (i = 0; i < MAX_KEY_SOURCES; i++)
+		{
+			if (keys_device->sources[i].fd >= 0 &&
+			        keys_device->sources[i].rdev == devnum)
 			{
-				nyx_error("Failed to read events from keypad event file");
-				return -1;
+				nyx_debug("Key event file %s removed", devnode);
+				remove_key_source(keys_device, &keys_device->sources[i]);
 			}
 		}
 	}
 
-	return numEvents;
+	udev_device_unref(dev);
 }
 
-#define MAX_EVENTS      64
-
-nyx_error_t keys_get_event(nyx_device_t *d, nyx_event_t **e)
+/**
+ * Watch the input subsystem for keyboards and add those already present.
+ * Without udev only KEYPAD_INPUT_DEVICE is used.
+ */
+static void
+init_hotplug(keys_device_t *keys_device)
 {
-	static InputEvent_t raw_events[MAX_EVENTS];
+	struct udev_enumerate *enumerate;
+	struct udev_list_entry *entry;
+	struct udev_device *dev;
+	struct epoll_event ev;
+	const char *devnode;
 
-	static int event_count = 0;
-	static int event_iter = 0;
+	keys_device->udev = udev_new();
+
+	if (NULL == keys_device->udev)
+	{
+		nyx_error("Could not initialize udev component; key hotplug will not be available");
+		return;
+	}
 
-	int rd = 0;
+	keys_device->monitor = udev_monitor_new_from_netlink(keys_device->udev, "udev");
 
-	keys_device_t *keys_device = (keys_device_t *) d;
+	if (NULL == keys_device->monitor ||
+	        udev_monitor_filter_add_match_subsystem_devtype(keys_device->monitor,
+	                "input", NULL) < 0 ||
+	        udev_monitor_enable_receiving(keys_device->monitor) < 0)
+	{
+		nyx_error("Failed to monitor input subsystem events");
+		goto error;
+	}
 
-	/*
-	 * Event bookkeeping...
-	 */
-	if (!event_iter)
+	ev.events = EPOLLIN;
+	ev.data.u32 = HOTPLUG_TAG;
+
+	if (epoll_ctl(keys_device->epoll_fd, EPOLL_CTL_ADD,
+	              udev_monitor_get_fd(keys_device->monitor), &ev) < 0)
 	{
-		event_count = read_input_event(raw_events, MAX_EVENTS);
-		keys_device->current_event_ptr = NULL;
+		nyx_error("Failed to watch input subsystem events");
+		goto error;
 	}
 
-	if (keys_device->current_event_ptr == NULL)
+	enumerate = udev_enumerate_new(keys_device->udev);
+
+	if (NULL == enumerate)
 	{
-		/*
-		 * let's allocate new event and hold it here.
-		 */
-		keys_device->current_event_ptr = keys_event_create();
+		return;
 	}
 
-	for (; event_iter < event_count;)
+	udev_enumerate_add_match_subsystem(enumerate, "input");
+	udev_enumerate_add_match_property(enumerate, "ID_INPUT_KEY", "1");
+	udev_enumerate_scan_devices(enumerate);
+
+	udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate))
 	{
-		InputEvent_t *input_event_ptr;
-		input_event_ptr = &raw_events[event_iter];
-		event_iter++;
+		dev = udev_device_new_from_syspath(keys_device->udev,
+		                                   udev_list_entry_get_name(entry));
 
-		if (input_event_ptr->type == EV_KEY)
-		{
-			keys_device->current_event_ptr->key_type = NYX_KEY_TYPE_STANDARD;
-			keys_device->current_event_ptr->key = lookup_key(keys_device,
-			                                      input_event_ptr->code, input_event_ptr->value,
-			                                      &keys_device->current_event_ptr->key_type);
-		}
-		else
+		if (NULL == dev)
 		{
 			continue;
 		}
 
-		keys_device->current_event_ptr->key_is_press
-		    = (input_event_ptr->value) ? true : false;
-		keys_device->current_event_ptr->key_is_auto_repeat
-		    = (input_event_ptr->value > 1) ? true : false;
-
-		*e = (nyx_event_t *) keys_device->current_event_ptr;
-		keys_device->current_event_ptr = NULL;
+		devnode = udev_device_get_devnode(dev);
 
-		/*
-		 * Generated event, bail out and let the caller know.
-		 */
-		if (NULL != *e)
+		if (devnode && strncmp(devnode, "/dev/input/event", 16) == 0)
 		{
-			break;
+			add_key_source(keys_device, devnode);
 		}
+
+		udev_device_unref(dev);
 	}
 
-	if (event_iter >= event_count)
+	udev_enumerate_unref(enumerate);
+	return;
+
+error:
+
+	if (keys_device->monitor)
 	{
-		event_iter = 0;
+		udev_monitor_unref(keys_device->monitor);
+		keys_device->monitor = NULL;
 	}
 
-	return NYX_ERROR_NONE;
+	udev_unref(keys_device->udev);
+	keys_device->udev = NULL;
+}
+
+static int
+init_keypad(keys_device_t *keys_device)
+{
+	struct epoll_event ev;
+	int i;
+
+	for (i = 0; i < MAX_KEY_SOURCES; i++)
+	{
+		keys_device->sources[i].fd = -1;
+	}
+
+	keys_device->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (keys_device->epoll_fd < 0)
+	{
+		nyx_error("Failed to create key event set");
+		return -1;
+	}
+
+	keys_device->repeat_code = -1;
+	keys_device->repeat[KEY_REPEAT_STANDARD].delay_ms = KEYS_REPEAT_DELAY_MS;
+	keys_device->repeat[KEY_REPEAT_STANDARD].period_ms = KEYS_REPEAT_PERIOD_MS;
+	keys_device->repeat[KEY_REPEAT_CUSTOM].delay_ms = KEYS_CUSTOM_REPEAT_DELAY_MS;
+	keys_device->repeat[KEY_REPEAT_CUSTOM].period_ms = KEYS_CUSTOM_REPEAT_PERIOD_MS;
+	keys_device->repeat_fd = timerfd_create(CLOCK_MONOTONIC,
+	                                        TFD_NONBLOCK | TFD_CLOEXEC);
+	ev.events = EPOLLIN;
+	ev.data.u32 = REPEAT_TAG;
+
+	if (keys_device->repeat_fd < 0 ||
+	        epoll_ctl(keys_device->epoll_fd, EPOLL_CTL_ADD, keys_device->repeat_fd,
+	                  &ev) < 0)
+	{
+		nyx_error("Failed to set up key repeat, keys will not repeat");
+	}
+
+	key_combo_init(&keys_device->combos);
+	keys_device->combo_fd = timerfd_create(CLOCK_MONOTONIC,
+	                                       TFD_NONBLOCK | TFD_CLOEXEC);
+	ev.data.u32 = COMBO_TAG;
+
+	if (keys_device->combo_fd < 0 ||
+	        epoll_ctl(keys_device->epoll_fd, EPOLL_CTL_ADD, keys_device->combo_fd,
+	                  &ev) < 0)
+	{
+		nyx_error("Failed to set up key combinations, long presses will not fire");
+	}
+
+#ifdef KEYPAD_INPUT_DEVICE
+
+	if (add_key_source(keys_device, KEYPAD_INPUT_DEVICE) < 0)
+	{
+		nyx_error("Error in opening keypad event file");
+	}
+
+#endif
+
+	init_hotplug(keys_device);
+
+	return 0;
 }
 
+static void *keys_reader_thread(void *arg);
+
+nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
+{
+	keys_device_t *keys_device = (keys_device_t *) calloc(sizeof(keys_device_t),
+	                             1);
+
+	if (G_UNLIKELY(!keys_device))
+	{
+		return NYX_ERROR_OUT_OF_MEMORY;
+	}
+
+	if (keymap_load(&keys_device->keymap, KEYS_KEYMAP_FILE) < 0)
+	{
+		keymap_init_default(&keys_device->keymap);
+	}
+
+	if (init_keypad(keys_device) < 0)
+	{
+		goto fail_unlock_settings;
+	}
+
+	if (input_reader_enabled())
+	{
+		keys_device->threaded = (input_reader_start(&keys_device->reader,
+		                         keys_reader_thread, keys_device) == 0);
+	}
+
+	nyx_module_register_method(i, (nyx_device_t *) keys_device,
+	                           NYX_GET_EVENT_SOURCE_MODULE_METHOD, "keys_get_event_source");
+	nyx_module_register_method(i, (nyx_device_t *) keys_device,
+	                           NYX_GET_EVENT_MODULE_METHOD, "keys_get_event");
+	nyx_module_register_method(i, (nyx_device_t *) keys_device,
+	                           NYX_RELEASE_EVENT_MODULE_METHOD, "keys_release_event");
+
+	*d = (nyx_device_t *) keys_device;
+
+	return NYX_ERROR_NONE;
+
+fail_unlock_settings:
+
+	keymap_release(&keys_device->keymap);
+	free(keys_device);
+
+	return NYX_ERROR_GENERIC;
+}
+
+nyx_error_t nyx_module_close(nyx_device_t *d)
+{
+	keys_device_t *keys_device = (keys_device_t *) d;
+	nyx_event_t *event_ptr;
+	int i;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (keys_device->threaded)
+	{
+		input_reader_stop(&keys_device->reader);
+
+		while (NULL != (event_ptr = input_queue_pop(&keys_device->reader.ready)))
+		{
+			free(event_ptr);
+		}
+	}
+
+	for (i = 0; i < MAX_KEY_SOURCES; i++)
+	{
+		if (keys_device->sources[i].fd >= 0)
+		{
+			close(keys_device->sources[i].fd);
+		}
+	}
+
+	if (keys_device->monitor)
+	{
+		udev_monitor_unref(keys_device->monitor);
+	}
+
+	if (keys_device->udev)
+	{
+		udev_unref(keys_device->udev);
+	}
+
+	if (keys_device->repeat_fd >= 0)
+	{
+		close(keys_device->repeat_fd);
+	}
+
+	if (keys_device->combo_fd >= 0)
+	{
+		close(keys_device->combo_fd);
+	}
+
+	close(keys_device->epoll_fd);
+	keymap_release(&keys_device->keymap);
+
+	nyx_debug("Freeing keys %p", d);
+	free(d);
+
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t keys_get_event_source(nyx_device_t *d, int *f)
+{
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == f)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	keys_device_t *keys_device = (keys_device_t *) d;
+
+	/* the epoll set is readable whenever one of the nodes is */
+	*f = keys_device->threaded ? keys_device->reader.wake_fd :
+	     keys_device->epoll_fd;
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Read what one node has pending with a single read(), dropping the node
+ * if it has gone away.
+ */
+static void
+read_key_source(keys_device_t *keys_device, key_source_t *source)
+{
+	ssize_t rd;
+
+	do
+	{
+		rd = read(source->fd, source->raw_events, sizeof(source->raw_events));
+	}
+	while (rd < 0 && errno == EINTR);
+
+	source->event_iter = 0;
+	source->event_count = (rd > 0) ? rd / sizeof(InputEvent_t) : 0;
+
+	if (rd < 0 && errno != EAGAIN)
+	{
+		nyx_error("Failed to read events from key event file");
+		remove_key_source(keys_device, source);
+	}
+}
+
+static nyx_event_keys_t *
+keys_event_from_code(keys_device_t *keys_device, uint16_t code, int32_t value)
+{
+	nyx_event_keys_t *event_ptr = keys_event_create();
+
+	if (NULL == event_ptr)
+	{
+		return NULL;
+	}
+
+	event_ptr->key = keymap_lookup(&keys_device->keymap, code,
+	                               &event_ptr->key_type);
+	event_ptr->key_is_press = (value) ? true : false;
+	event_ptr->key_is_auto_repeat = (value > 1) ? true : false;
+
+	return event_ptr;
+}
+
+/**
+ * Report the keys of a node whose state changed while its input was
+ * dropped, as presses and releases, up to max events. Returns false while
+ * some are left.
+ */
+static bool
+keys_resync_events(keys_device_t *keys_device, key_source_t *source,
+                   nyx_event_t **events, int max, int *n)
+{
+	nyx_event_keys_t *event_ptr;
+	bool down;
+
+	for (; source->resync_next < KEY_CNT; source->resync_next++)
+	{
+		int code = source->resync_next;
+
+		down = TEST_BIT(code, source->resync_state);
+
+		if (down == TEST_BIT(code, source->key_state))
+		{
+			continue;
+		}
+
+		if (__atomic_load_n(&keys_device->combos_only, __ATOMIC_RELAXED))
+		{
+			set_key_state(keys_device, source, code, down);
+			continue;
+		}
+
+		if (*n == max ||
+		        NULL == (event_ptr = keys_event_from_code(keys_device, code, down)))
+		{
+			return false;
+		}
+
+		set_key_state(keys_device, source, code, down);
+		events[(*n)++] = (nyx_event_t *) event_ptr;
+	}
+
+	source->resyncing = false;
+
+	return true;
+}
+
+/**
+ * Deal with the kernel's SYN_DROPPED: events up to the next SYN_REPORT are
+ * incomplete and skipped, then the key state is read back and the keys that
+ * changed meanwhile are reported. If it can't be read back, every key still
+ * down is released rather than left stuck. Returns true if the event was
+ * consumed here, false if it is to be decoded as usual.
+ */
+static bool
+keys_handle_dropped(keys_device_t *keys_device, key_source_t *source,
+                    InputEvent_t *input_event_ptr, nyx_event_t **events, int max,
+                    int *n)
+{
+	if (input_event_ptr->type == EV_SYN && input_event_ptr->code == SYN_DROPPED)
+	{
+		if (!source->resync_pending)
+		{
+			__atomic_fetch_add(&keys_device->syn_dropped, 1, __ATOMIC_RELAXED);
+			nyx_warn("Key input dropped, resynchronizing");
+		}
+
+		source->resync_pending = true;
+		source->event_iter++;
+		return true;
+	}
+
+	if (!source->resync_pending)
+	{
+		return false;
+	}
+
+	if (input_event_ptr->type == EV_SYN && input_event_ptr->code == SYN_REPORT)
+	{
+		if (!source->resyncing)
+		{
+			query_key_state(source->fd, source->resync_state);
+			source->resyncing = true;
+			source->resync_next = 0;
+		}
+
+		/* stay on the SYN_REPORT until every change has been reported */
+		if (!keys_resync_events(keys_device, source, events, max, n))
+		{
+			return true;
+		}
+
+		source->resync_pending = false;
+	}
+
+	source->event_iter++;
+	return true;
+}
+
+/**
+ * Decode the events left from the last read of a node, up to max of them.
+ * Returns false if an event could not be allocated.
+ */
+static bool
+keys_decode_source(keys_device_t *keys_device, key_source_t *source,
+                   nyx_event_t **events, int max, int *n)
+{
+	/* a node that went away only has its keys to release */
+	if (source->removed)
+	{
+		if (keys_resync_events(keys_device, source, events, max, n))
+		{
+			source->removed = false;
+		}
+
+		return true;
+	}
+
+	while (*n < max && source->event_iter < source->event_count)
+	{
+		InputEvent_t *input_event_ptr = &source->raw_events[source->event_iter];
+		nyx_event_keys_t *event_ptr;
+
+		if (keys_handle_dropped(keys_device, source, input_event_ptr, events, max,
+		                        n))
+		{
+			continue;
+		}
+
+		/* kernel repeats are replaced by the module's own */
+		if (input_event_ptr->type != EV_KEY || input_event_ptr->code >= KEY_CNT ||
+		        input_event_ptr->value > 1)
+		{
+			source->event_iter++;
+			continue;
+		}
+
+		if (__atomic_load_n(&keys_device->combos_only, __ATOMIC_RELAXED))
+		{
+			source->event_iter++;
+			set_key_state(keys_device, source, input_event_ptr->code,
+			              input_event_ptr->value != 0);
+			continue;
+		}
+
+		event_ptr = keys_event_from_code(keys_device, input_event_ptr->code,
+		                                 input_event_ptr->value);
+
+		if (NULL == event_ptr)
+		{
+			return false;
+		}
+
+		source->event_iter++;
+		set_key_state(keys_device, source, input_event_ptr->code,
+		              input_event_ptr->value != 0);
+
+		KEY_EVENT(event_ptr)->kernel_time = input_event_ptr->time;
+		KEY_EVENT(event_ptr)->kernel_clock = source->clock;
+		KEY_EVENT(event_ptr)->has_kernel_time = true;
+
+		events[(*n)++] = (nyx_event_t *) event_ptr;
+	}
+
+	return true;
+}
+
+static bool
+keys_input_pending(keys_device_t *keys_device)
+{
+	int i;
+
+	for (i = 0; i < MAX_KEY_SOURCES; i++)
+	{
+		key_source_t *source = &keys_device->sources[i];
+
+		if (source->removed || source->event_iter < source->event_count)
+		{
+			return true;
+		}
+	}
+
+	return keys_device->repeat_due || keys_device->combos.due;
+}
+
+/**
+ * Decode the key events left from the last reads, reading every ready node
+ * once all of them have been decoded.
+ */
+static nyx_error_t
+keys_decode_events(keys_device_t *keys_device, nyx_event_t **events, int max,
+                   int *n)
+{
+	struct epoll_event ready[MAX_KEY_SOURCES + 3];
+	nyx_event_keys_t *event_ptr;
+	uint64_t ticks;
+	int32_t combo_key;
+	int num_ready, i;
+
+	*n = 0;
+
+	if (!keys_input_pending(keys_device))
+	{
+		num_ready = epoll_wait(keys_device->epoll_fd, ready,
+		                       G_N_ELEMENTS(ready), 0);
+
+		for (i = 0; i < num_ready; i++)
+		{
+			if (ready[i].data.u32 == HOTPLUG_TAG)
+			{
+				handle_hotplug(keys_device);
+			}
+			else if (ready[i].data.u32 == REPEAT_TAG)
+			{
+				/* ticks missed while busy are not caught up on */
+				if (read(keys_device->repeat_fd, &ticks, sizeof(ticks)) == sizeof(ticks) &&
+				        keys_device->repeat_code >= 0)
+				{
+					keys_device->repeat_due = true;
+				}
+			}
+			else if (ready[i].data.u32 == COMBO_TAG)
+			{
+				if (read(keys_device->combo_fd, &ticks, sizeof(ticks)) == sizeof(ticks))
+				{
+					/* the timer is disarmed once it expires */
+					keys_device->combo_deadline = 0;
+					update_combos(keys_device);
+				}
+			}
+			else if (keys_device->sources[ready[i].data.u32].fd < 0)
+			{
+				continue;
+			}
+			else if (ready[i].events & (EPOLLERR | EPOLLHUP))
+			{
+				remove_key_source(keys_device, &keys_device->sources[ready[i].data.u32]);
+			}
+			else
+			{
+				read_key_source(keys_device, &keys_device->sources[ready[i].data.u32]);
+			}
+		}
+	}
+
+	for (i = 0; i < MAX_KEY_SOURCES && *n < max; i++)
+	{
+		if (!keys_decode_source(keys_device, &keys_device->sources[i], events, max,
+		                        n))
+		{
+			return (*n > 0) ? NYX_ERROR_NONE : NYX_ERROR_OUT_OF_MEMORY;
+		}
+	}
+
+	while (*n < max && key_combo_next_due(&keys_device->combos, &combo_key))
+	{
+		event_ptr = keys_event_create();
+
+		if (NULL == event_ptr)
+		{
+			break;
+		}
+
+		event_ptr->key_type = NYX_KEY_TYPE_CUSTOM;
+		event_ptr->key = combo_key;
+		event_ptr->key_is_press = true;
+		events[(*n)++] = (nyx_event_t *) event_ptr;
+	}
+
+	/* a release decoded above has already cancelled the repeat */
+	if (keys_device->repeat_due && *n < max)
+	{
+		event_ptr = keys_event_from_code(keys_device, keys_device->repeat_code, 2);
+
+		if (NULL != event_ptr)
+		{
+			keys_device->repeat_due = false;
+			events[(*n)++] = (nyx_event_t *) event_ptr;
+		}
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Reader thread: decode key events as soon as they arrive and queue them for
+ * keys_get_events().
+ */
+static void *
+keys_reader_thread(void *arg)
+{
+	keys_device_t *keys_device = (keys_device_t *) arg;
+	nyx_event_t *events[MAX_EVENTS];
+	int n, k;
+
+	do
+	{
+		do
+		{
+			keys_decode_events(keys_device, events, MAX_EVENTS, &n);
+
+			for (k = 0; k < n; k++)
+			{
+				if (!input_reader_publish(&keys_device->reader, events[k]))
+				{
+					while (k < n)
+					{
+						free(events[k++]);
+					}
+
+					return NULL;
+				}
+			}
+		}
+		while (n > 0);
+	}
+	while (input_reader_wait(&keys_device->reader, keys_device->epoll_fd));
+
+	return NULL;
+}
+
+/* Record the latency of the key events handed out to the caller */
+static void
+record_latency(keys_device_t *keys_device, nyx_event_t **events, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		const key_event_t *key_event = KEY_EVENT(events[i]);
+
+		if (key_event->has_kernel_time)
+		{
+			latency_histogram_record(&keys_device->latency,
+			                         input_event_latency(key_event->kernel_clock,
+			                                 &key_event->kernel_time));
+		}
+	}
+}
+
+/**
+ * Deliver every key event left from the last read, reading the event node
+ * again once all of them have been delivered. Up to max events are stored in
+ * events and their number in n.
+ */
+nyx_error_t keys_get_events(nyx_device_t *d, nyx_event_t **events, int max,
+                            int *n)
+{
+	keys_device_t *keys_device = (keys_device_t *) d;
+	nyx_event_t *event_ptr;
+	nyx_error_t error;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == events || NULL == n || max <= 0)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	if (!keys_device->threaded)
+	{
+		error = keys_decode_events(keys_device, events, max, n);
+
+		if (NYX_ERROR_NONE == error)
+		{
+			record_latency(keys_device, events, *n);
+		}
+
+		return error;
+	}
+
+	*n = 0;
+
+	while (*n < max &&
+	        NULL != (event_ptr = input_reader_consume(&keys_device->reader)))
+	{
+		events[(*n)++] = event_ptr;
+	}
+
+	record_latency(keys_device, events, *n);
+
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t keys_get_event(nyx_device_t *d, nyx_event_t **e)
+{
+	int n = 0;
+	nyx_error_t error = keys_get_events(d, e, 1, &n);
+
+	if (NULL != e && 0 == n)
+	{
+		*e = NULL;
+	}
+
+	return error;
+}
+
+/**
+ * Copy the histogram of latencies from the kernel time stamp of a key event
+ * to its delivery, see LATENCY_HISTOGRAM_BUCKETS for the bucket bounds. Call
+ * it from the thread that calls keys_get_events().
+ */
+nyx_error_t keys_get_latency_histogram(nyx_device_t *d, unsigned int *buckets,
+                                       unsigned int num_buckets)
+{
+	keys_device_t *keys_device = (keys_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == buckets)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	latency_histogram_copy(&keys_device->latency, buckets, num_buckets);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Tell whether a key, given as its linux/input.h KEY_* code, is currently
+ * down. Reflects the events decoded so far, so a caller that has handled
+ * every event sees the state they describe.
+ */
+nyx_error_t keys_is_key_down(nyx_device_t *d, unsigned int code, bool *down)
+{
+	keys_device_t *keys_device = (keys_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == down || code >= KEY_CNT)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	*down = (__atomic_load_n(&keys_device->key_state[code / BITS_PER_LONG],
+	                         __ATOMIC_RELAXED) >> (code % BITS_PER_LONG)) & 1;
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Report how often the kernel dropped key input because it was not read in
+ * time. Each drop is followed by a resync of the key state.
+ */
+nyx_error_t keys_get_dropped_count(nyx_device_t *d, unsigned int *drops)
+{
+	keys_device_t *keys_device = (keys_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == drops)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	*drops = __atomic_load_n(&keys_device->syn_dropped, __ATOMIC_RELAXED);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Set the autorepeat of a class of keys, see key_repeat_class_t. A delay or
+ * period of 0 turns it off. Takes effect with the next key press.
+ */
+nyx_error_t keys_set_repeat(nyx_device_t *d, int key_class,
+                            unsigned int delay_ms, unsigned int period_ms)
+{
+	keys_device_t *keys_device = (keys_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (key_class < 0 || key_class >= KEY_REPEAT_NUM_CLASSES)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	/* read by the reader thread on the next key press */
+	__atomic_store_n(&keys_device->repeat[key_class].delay_ms, delay_ms,
+	                 __ATOMIC_RELAXED);
+	__atomic_store_n(&keys_device->repeat[key_class].period_ms, period_ms,
+	                 __ATOMIC_RELAXED);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Report only key combinations, KEY_COMBO_*, and none of the presses and
+ * releases they are made of. Keys don't repeat in this mode either.
+ */
+nyx_error_t keys_set_combos_only(nyx_device_t *d, bool combos_only)
+{
+	keys_device_t *keys_device = (keys_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	__atomic_store_n(&keys_device->combos_only, combos_only, __ATOMIC_RELAXED);
+
+	return NYX_ERROR_NONE;
+}
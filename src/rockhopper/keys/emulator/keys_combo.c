@@ -0,0 +1,158 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <string.h>
+#include <linux/input.h>
+
+#include "keys_combo.h"
+
+#define BITS_PER_LONG           (sizeof(unsigned long) * 8)
+#define TEST_BIT(bit, array)    ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+#define NSEC_PER_MSEC           1000000LL
+
+static const key_combo_t default_combos[] =
+{
+	{ { KEY_END }, 1, 1000, KEY_COMBO_POWER_LONG_PRESS },
+	{ { KEY_END, KEY_VOLUMEDOWN }, 2, 0, KEY_COMBO_POWER_VOLUME_DOWN },
+	{ { KEY_END, KEY_VOLUMEUP }, 2, 0, KEY_COMBO_POWER_VOLUME_UP },
+};
+
+void
+key_combo_init(key_combo_state_t *pState)
+{
+	memset(pState, 0, sizeof(*pState));
+	pState->pCombos = default_combos;
+	pState->numCombos = sizeof(default_combos) / sizeof(default_combos[0]);
+}
+
+static bool
+combo_held(const key_combo_t *pCombo, const unsigned long *pKeyState)
+{
+	int i;
+
+	for (i = 0; i < pCombo->numKeys; i++)
+	{
+		if (!TEST_BIT(pCombo->keys[i], pKeyState))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Whether the key is part of any combination, other keys never change them
+ */
+bool
+key_combo_uses(const key_combo_state_t *pState, uint16_t code)
+{
+	int i, j;
+
+	for (i = 0; i < pState->numCombos; i++)
+	{
+		for (j = 0; j < pState->pCombos[i].numKeys; j++)
+		{
+			if (pState->pCombos[i].keys[j] == code)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/**
+ *******************************************************************************
+ * @brief Match the combinations against the keys that are down
+ *
+ * @param  pState       IN/OUT  matcher, fired combinations are marked due
+ * @param  pKeyState    IN      bitmap of the keys down, indexed by key code
+ * @param  now          IN      monotonic time in ns
+ *
+ * @retval time at which to call again for a combination still being held,
+ *         0 if there is none
+ *******************************************************************************
+ */
+int64_t
+key_combo_update(key_combo_state_t *pState, const unsigned long *pKeyState,
+                 int64_t now)
+{
+	int64_t next = 0, deadline;
+	int i;
+
+	for (i = 0; i < pState->numCombos; i++)
+	{
+		const key_combo_t *pCombo = &pState->pCombos[i];
+		uint32_t bit = 1U << i;
+
+		if (!combo_held(pCombo, pKeyState))
+		{
+			pState->heldSince[i] = 0;
+			pState->fired &= ~bit;
+			continue;
+		}
+
+		if (pState->fired & bit)
+		{
+			continue;
+		}
+
+		if (0 == pState->heldSince[i])
+		{
+			pState->heldSince[i] = now;
+		}
+
+		deadline = pState->heldSince[i] + pCombo->holdMs * NSEC_PER_MSEC;
+
+		if (deadline <= now)
+		{
+			pState->fired |= bit;
+			pState->due |= bit;
+		}
+		else if (0 == next || deadline < next)
+		{
+			next = deadline;
+		}
+	}
+
+	return next;
+}
+
+/**
+ * Take the next fired combination to report, false if there is none
+ */
+bool
+key_combo_next_due(key_combo_state_t *pState, int32_t *pKey)
+{
+	int i;
+
+	for (i = 0; i < pState->numCombos; i++)
+	{
+		if (pState->due & (1U << i))
+		{
+			pState->due &= ~(1U << i);
+			*pKey = pState->pCombos[i].key;
+			return true;
+		}
+	}
+
+	return false;
+}
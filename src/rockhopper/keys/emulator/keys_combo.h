@@ -0,0 +1,69 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#ifndef __KEYS_COMBO_H
+#define __KEYS_COMBO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define KEY_COMBO_MAX_KEYS      3
+#define KEY_COMBO_MAX           32
+
+/*
+ * Keys reported, as NYX_KEY_TYPE_CUSTOM, when a combination fires. They
+ * start well above the nyx custom keys.
+ */
+#define KEY_COMBO_KEY_BASE      0x10000
+
+enum
+{
+    KEY_COMBO_POWER_LONG_PRESS = KEY_COMBO_KEY_BASE,
+    KEY_COMBO_POWER_VOLUME_DOWN,
+    KEY_COMBO_POWER_VOLUME_UP,
+};
+
+/**
+ * A combination fires once all of its keys have been down together for
+ * holdMs, right away if that is 0. A long press is a combination of one key.
+ * It fires once per hold, releasing any of its keys rearms it.
+ */
+typedef struct key_combo
+{
+	uint16_t keys[KEY_COMBO_MAX_KEYS];  /**< linux/input.h KEY_* codes */
+	int numKeys;
+	unsigned int holdMs;
+	int32_t key;                        /**< reported when it fires */
+} key_combo_t;
+
+typedef struct key_combo_state
+{
+	const key_combo_t *pCombos;
+	int numCombos;
+	int64_t heldSince[KEY_COMBO_MAX];   /**< ns, 0 while not all keys are down */
+	uint32_t fired;                     /**< fired during the current hold */
+	uint32_t due;                       /**< fired and not yet reported */
+} key_combo_state_t;
+
+void key_combo_init(key_combo_state_t *pState);
+int64_t key_combo_update(key_combo_state_t *pState, const unsigned long *pKeyState,
+                         int64_t now);
+bool key_combo_uses(const key_combo_state_t *pState, uint16_t code);
+bool key_combo_next_due(key_combo_state_t *pState, int32_t *pKey);
+
+#endif  /* __KEYS_COMBO_H */
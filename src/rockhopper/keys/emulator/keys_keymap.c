@@ -0,0 +1,131 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <nyx/module/nyx_log.h>
+
+#include "keys_keymap.h"
+
+#define CUSTOM(key)     { key, NYX_KEY_TYPE_CUSTOM }
+
+/* Built in mapping, used unless a keymap file is installed */
+static const keymap_entry_t default_keymap[KEY_CNT] =
+{
+	[KEY_HOME] = CUSTOM(NYX_KEYS_CUSTOM_KEY_HOME),
+	[KEY_VOLUMEUP] = CUSTOM(NYX_KEYS_CUSTOM_KEY_VOL_UP),
+	[KEY_VOLUMEDOWN] = CUSTOM(NYX_KEYS_CUSTOM_KEY_VOL_DOWN),
+	[KEY_END] = CUSTOM(NYX_KEYS_CUSTOM_KEY_POWER_ON),
+	[KEY_PLAY] = CUSTOM(NYX_KEYS_CUSTOM_KEY_MEDIA_PLAY),
+	[KEY_PAUSE] = CUSTOM(NYX_KEYS_CUSTOM_KEY_MEDIA_PAUSE),
+	[KEY_STOP] = CUSTOM(NYX_KEYS_CUSTOM_KEY_MEDIA_STOP),
+	[KEY_NEXT] = CUSTOM(NYX_KEYS_CUSTOM_KEY_MEDIA_NEXT),
+	[KEY_PREVIOUS] = CUSTOM(NYX_KEYS_CUSTOM_KEY_MEDIA_PREVIOUS),
+	// keyboard function keys
+	[KEY_SEARCH] = CUSTOM(NYX_KEYS_CUSTOM_KEY_SEARCH),
+	[KEY_BRIGHTNESSDOWN] = CUSTOM(NYX_KEYS_CUSTOM_KEY_BRIGHTNESS_DOWN),
+	[KEY_BRIGHTNESSUP] = CUSTOM(NYX_KEYS_CUSTOM_KEY_BRIGHTNESS_UP),
+	[KEY_MUTE] = CUSTOM(NYX_KEYS_CUSTOM_KEY_VOL_MUTE),
+	[KEY_REWIND] = CUSTOM(NYX_KEYS_CUSTOM_KEY_MEDIA_REWIND),
+	[KEY_FASTFORWARD] = CUSTOM(NYX_KEYS_CUSTOM_KEY_MEDIA_FASTFORWARD),
+};
+
+void
+keymap_init_default(keymap_t *pKeymap)
+{
+	pKeymap->pEntries = default_keymap;
+	pKeymap->numEntries = KEY_CNT;
+	pKeymap->pMap = NULL;
+	pKeymap->mapSize = 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Map a keymap file in place of the built in mapping
+ *
+ * @param  pKeymap  OUT     keymap to set up, left alone on error
+ * @param  pPath    IN      keymap file, see keymap_header_t
+ *
+ * @retval 0 on success, -1 if the file is missing or malformed
+ *******************************************************************************
+ */
+int
+keymap_load(keymap_t *pKeymap, const char *pPath)
+{
+	const keymap_header_t *pHeader;
+	struct stat st;
+	void *pMap;
+	int fd = open(pPath, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(keymap_header_t))
+	{
+		nyx_error("Keymap %s is too short", pPath);
+		close(fd);
+		return -1;
+	}
+
+	pMap = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (MAP_FAILED == pMap)
+	{
+		nyx_error("Failed to map keymap %s", pPath);
+		return -1;
+	}
+
+	pHeader = (const keymap_header_t *) pMap;
+
+	if (memcmp(pHeader->magic, KEYMAP_MAGIC, sizeof(pHeader->magic)) != 0 ||
+	        pHeader->version != KEYMAP_VERSION || pHeader->numEntries > KEY_CNT ||
+	        st.st_size != (off_t)(sizeof(keymap_header_t) +
+	                              pHeader->numEntries * sizeof(keymap_entry_t)))
+	{
+		nyx_error("Keymap %s is not a version %d keymap", pPath, KEYMAP_VERSION);
+		munmap(pMap, st.st_size);
+		return -1;
+	}
+
+	pKeymap->pEntries = (const keymap_entry_t *)(pHeader + 1);
+	pKeymap->numEntries = pHeader->numEntries;
+	pKeymap->pMap = pMap;
+	pKeymap->mapSize = st.st_size;
+
+	nyx_info("Using keymap %s with %u entries", pPath, pKeymap->numEntries);
+
+	return 0;
+}
+
+void
+keymap_release(keymap_t *pKeymap)
+{
+	if (NULL != pKeymap->pMap)
+	{
+		munmap(pKeymap->pMap, pKeymap->mapSize);
+	}
+
+	keymap_init_default(pKeymap);
+}
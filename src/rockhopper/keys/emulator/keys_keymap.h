@@ -0,0 +1,77 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#ifndef __KEYS_KEYMAP_H
+#define __KEYS_KEYMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/input.h>
+
+#include <nyx/nyx_module.h>
+
+#define KEYMAP_MAGIC        "NYXKEYMP"
+#define KEYMAP_VERSION      1
+
+/**
+ * What a linux/input.h key code is reported as. An entry with key 0 passes
+ * the code through as a standard key.
+ */
+typedef struct keymap_entry
+{
+	int32_t key;
+	int32_t type;           /**< nyx_key_type_t */
+} keymap_entry_t;
+
+/**
+ * A keymap file is this header followed by numEntries entries, indexed by
+ * key code. Codes past the end pass through as standard keys.
+ */
+typedef struct keymap_header
+{
+	char magic[8];          /**< KEYMAP_MAGIC, not terminated */
+	uint32_t version;
+	uint32_t numEntries;    /**< at most KEY_CNT */
+} keymap_header_t;
+
+typedef struct keymap
+{
+	const keymap_entry_t *pEntries;
+	unsigned int numEntries;
+	void *pMap;             /**< mapped keymap file, NULL for the default */
+	size_t mapSize;
+} keymap_t;
+
+void keymap_init_default(keymap_t *pKeymap);
+int keymap_load(keymap_t *pKeymap, const char *pPath);
+void keymap_release(keymap_t *pKeymap);
+
+static inline int
+keymap_lookup(const keymap_t *pKeymap, uint16_t code, nyx_key_type_t *pType)
+{
+	if (code < pKeymap->numEntries && pKeymap->pEntries[code].key != 0)
+	{
+		*pType = (nyx_key_type_t) pKeymap->pEntries[code].type;
+		return pKeymap->pEntries[code].key;
+	}
+
+	*pType = NYX_KEY_TYPE_STANDARD;
+	return code;
+}
+
+#endif  /* __KEYS_KEYMAP_H */
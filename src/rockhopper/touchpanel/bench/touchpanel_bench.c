@@ -0,0 +1,445 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/**
+ * @file touchpanel_bench.c
+ *
+ * @brief Drives the touchpanel module from a capture, see
+ * touchpanel_capture.h, and reports its throughput, allocations and the time
+ * spent per pipeline stage. Without a capture a multi-finger protocol B trace
+ * is synthesized, so it runs on any Linux box. Built with
+ * -DBUILD_BENCHMARKS=YES.
+ *
+ * Usage: touchpanel_bench [-c|-s] [-t] [-f fingers] [-n frames] [-w output] [capture]
+ *   -c    deliver in coalescing mode
+ *   -s    deliver through the shared frame ring
+ *   -t    decode on a reader thread
+ *   -f    fingers of the synthesized trace (default 5)
+ *   -n    frames of the synthesized trace (default 100000)
+ *   -w    keep the synthesized trace in this file
+ */
+
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/input.h>
+
+#include <nyx/nyx_module.h>
+#include <nyx/module/nyx_event_touchpanel_internal.h>
+
+#include "touchpanel_gestures.h"
+#include "touchpanel_capture.h"
+#include "touchpanel_shm.h"
+
+/* module entry points, looked up by symbol when loaded by nyx */
+nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d);
+nyx_error_t nyx_module_close(nyx_device_t *d);
+nyx_error_t touchpanel_get_events(nyx_device_t *d, nyx_event_t **events,
+                                  int max, int *n);
+nyx_error_t touchpanel_release_event(nyx_device_t *d, nyx_event_t *e);
+nyx_error_t touchpanel_get_event_source(nyx_device_t *d, int *f);
+nyx_error_t touchpanel_set_mode(nyx_device_t *d, int m);
+nyx_error_t touchpanel_get_shared_ring(nyx_device_t *d, int *mem_fd,
+                                       int *wake_fd);
+nyx_error_t touchpanel_get_read_stats(nyx_device_t *d, unsigned int *syscalls,
+                                      unsigned int *frames);
+nyx_error_t touchpanel_get_event_pool_stats(nyx_device_t *d,
+        unsigned int *allocated, unsigned int *high_water);
+nyx_error_t touchpanel_get_stage_times(nyx_device_t *d, uint64_t *stage_ns,
+                                       unsigned int num_stages);
+
+#define BENCH_PANEL_MAX     4095
+#define BENCH_DISPLAY_X     1920
+#define BENCH_DISPLAY_Y     1080
+#define BENCH_SLOTS         10
+#define BENCH_FRAME_USEC    4167    /* 240 Hz */
+#define BENCH_COALESCE_MODE 1       /* TOUCHPANEL_MODE_COALESCE */
+#define BENCH_SHARED_MODE   2       /* TOUCHPANEL_MODE_SHARED_RING */
+#define BENCH_BATCH         64
+#define BENCH_IDLE_MS       200     /* reader thread silence ending a run */
+
+static const char *stage_names[] = { "read", "decode", "generate", "deliver" };
+
+#define NUM_STAGES  (sizeof(stage_names) / sizeof(stage_names[0]))
+
+/* The module is driven directly rather than through nyx */
+nyx_error_t nyx_module_register_method(nyx_instance_t i, nyx_device_t *d,
+                                       module_method_t method, const char *symbol)
+{
+	return NYX_ERROR_NONE;
+}
+
+static void
+put_event(input_event_t *events, int *count, long usec, uint16_t type,
+          uint16_t code, int32_t value)
+{
+	input_event_t *event = &events[(*count)++];
+
+	event->time.tv_sec = usec / 1000000;
+	event->time.tv_usec = usec % 1000000;
+	event->type = type;
+	event->code = code;
+	event->value = value;
+}
+
+/**
+ * Write a protocol B trace of fingers circling around the panel centre.
+ * Each finger is lifted and put down again every few hundred frames.
+ */
+static int
+synthesize_trace(const char *path, int fingers, int frames)
+{
+	capture_header_t header;
+	input_event_t events[BENCH_SLOTS * 4 + 1];
+	int fd, frame, slot;
+
+	memset(&header, 0, sizeof(header));
+	header.panelMaxX = BENCH_PANEL_MAX;
+	header.panelMaxY = BENCH_PANEL_MAX;
+	header.displayX = BENCH_DISPLAY_X;
+	header.displayY = BENCH_DISPLAY_Y;
+	header.mtSlots = BENCH_SLOTS;
+
+	fd = capture_open_record(path, &header);
+
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	for (frame = 0; frame < frames; frame++)
+	{
+		long usec = 1000000L + (long) frame * BENCH_FRAME_USEC;
+		int count = 0;
+
+		for (slot = 0; slot < fingers; slot++)
+		{
+			int phase = (frame + slot * 37) % 400;
+			double angle = frame * 0.01 + slot * 2 * M_PI / fingers;
+			int radius = 400 + 150 * slot;
+
+			put_event(events, &count, usec, EV_ABS, ABS_MT_SLOT, slot);
+
+			if (phase == 399)
+			{
+				put_event(events, &count, usec, EV_ABS, ABS_MT_TRACKING_ID, -1);
+				continue;
+			}
+
+			if (phase == 0 || frame == 0)
+			{
+				put_event(events, &count, usec, EV_ABS, ABS_MT_TRACKING_ID,
+				          frame * BENCH_SLOTS + slot);
+			}
+
+			put_event(events, &count, usec, EV_ABS, ABS_MT_POSITION_X,
+			          BENCH_PANEL_MAX / 2 + (int)(radius * cos(angle)));
+			put_event(events, &count, usec, EV_ABS, ABS_MT_POSITION_Y,
+			          BENCH_PANEL_MAX / 2 + (int)(radius * sin(angle)));
+		}
+
+		put_event(events, &count, usec, EV_SYN, SYN_REPORT, 0);
+
+		if (write(fd, events, count * sizeof(input_event_t)) !=
+		        (ssize_t)(count * sizeof(input_event_t)))
+		{
+			close(fd);
+			return -1;
+		}
+	}
+
+	close(fd);
+	return 0;
+}
+
+static double
+now_seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Read the frames published since the last call in place, the way a client
+ * of the shared ring does. Returns the number of frames read.
+ */
+static int
+read_shared_ring(const touch_shm_ring_t *ring, uint64_t *next, uint64_t *lost,
+                 long *checksum)
+{
+	uint64_t end = touch_shm_available(ring, next, lost);
+	int frames = 0, i;
+
+	for (; *next < end; (*next)++)
+	{
+		const touch_shm_frame_t *frame = touch_shm_frame(ring, *next);
+		long sum = 0;
+
+		if (!touch_shm_frame_begin(frame, *next))
+		{
+			(*lost)++;
+			continue;
+		}
+
+		for (i = 0; i < frame->itemCount && i < TOUCH_SHM_MAX_ITEMS; i++)
+		{
+			sum += frame->items[i].x + frame->items[i].y;
+		}
+
+		if (!touch_shm_frame_end(frame, *next))
+		{
+			(*lost)++;
+			continue;
+		}
+
+		*checksum += sum;
+		frames++;
+	}
+
+	return frames;
+}
+
+int
+main(int argc, char **argv)
+{
+	char trace[] = "/tmp/touchpanel_bench.XXXXXX";
+	const char *path = NULL, *output = NULL;
+	int fingers = 5, frames = 100000, coalesce = 0, shared = 0, threaded = 0;
+	unsigned int syscalls, delivered, allocated, high_water, i;
+	uint64_t stage_ns[NUM_STAGES];
+	long raw_events;
+	int idle = 0, opt, fd, n, k;
+	double start, elapsed, last;
+	struct pollfd source;
+	touch_shm_ring_t *ring = NULL;
+	uint64_t next = 0, lost = 0;
+	long checksum = 0;
+	uint64_t wakeups;
+	int mem_fd;
+	nyx_device_t *device = NULL;
+	nyx_event_t *events[BENCH_BATCH];
+	struct stat st;
+
+	while ((opt = getopt(argc, argv, "cstf:n:w:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'c':
+				coalesce = 1;
+				break;
+
+			case 's':
+				shared = 1;
+				break;
+
+			case 't':
+				threaded = 1;
+				break;
+
+			case 'f':
+				fingers = atoi(optarg);
+				break;
+
+			case 'n':
+				frames = atoi(optarg);
+				break;
+
+			case 'w':
+				output = optarg;
+				break;
+
+			default:
+				fprintf(stderr, "usage: %s [-c|-s] [-t] [-f fingers] [-n frames] "
+				        "[-w output] [capture]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind < argc)
+	{
+		path = argv[optind];
+	}
+	else
+	{
+		if (fingers < 1 || fingers > BENCH_SLOTS || frames < 1)
+		{
+			fprintf(stderr, "fingers must be 1-%d and frames positive\n", BENCH_SLOTS);
+			return 1;
+		}
+
+		if (output)
+		{
+			path = output;
+		}
+		else
+		{
+			fd = mkstemp(trace);
+
+			if (fd < 0)
+			{
+				perror("mkstemp");
+				return 1;
+			}
+
+			close(fd);
+			path = trace;
+		}
+
+		if (synthesize_trace(path, fingers, frames) < 0)
+		{
+			fprintf(stderr, "failed to write %s\n", path);
+			return 1;
+		}
+	}
+
+	if (stat(path, &st) < 0)
+	{
+		perror(path);
+		return 1;
+	}
+
+	raw_events = (st.st_size - sizeof(capture_header_t)) / sizeof(input_event_t);
+
+	setenv("NYX_TOUCHPANEL_REPLAY", path, 1);
+
+	if (threaded)
+	{
+		setenv("NYX_INPUT_READER_THREAD", "1", 1);
+	}
+
+	if (nyx_module_open(NULL, &device) != NYX_ERROR_NONE)
+	{
+		fprintf(stderr, "failed to replay %s\n", path);
+		return 1;
+	}
+
+	if (coalesce)
+	{
+		touchpanel_set_mode(device, BENCH_COALESCE_MODE);
+	}
+
+	touchpanel_get_event_source(device, &source.fd);
+
+	if (shared)
+	{
+		if (touchpanel_set_mode(device, BENCH_SHARED_MODE) != NYX_ERROR_NONE ||
+		        touchpanel_get_shared_ring(device, &mem_fd, &source.fd) != NYX_ERROR_NONE)
+		{
+			fprintf(stderr, "no shared ring\n");
+			return 1;
+		}
+
+		ring = mmap(NULL, TOUCH_SHM_SIZE, PROT_READ, MAP_SHARED, mem_fd, 0);
+
+		if (MAP_FAILED == ring)
+		{
+			perror("mmap");
+			return 1;
+		}
+	}
+
+	source.events = POLLIN;
+
+	start = last = now_seconds();
+
+	/*
+	 * The input is exhausted once a read turns up nothing, or once the
+	 * reader thread stays silent for a while
+	 */
+	while (idle < 2)
+	{
+		touchpanel_get_events(device, events, BENCH_BATCH, &n);
+
+		if (ring)
+		{
+			n = read_shared_ring(ring, &next, &lost, &checksum);
+		}
+
+		if (0 == n)
+		{
+			if (threaded && poll(&source, 1, BENCH_IDLE_MS) > 0)
+			{
+				/* the ring eventfd counts wakeups, clear it before reading */
+				if (ring && read(source.fd, &wakeups, sizeof(wakeups)) < 0)
+				{
+					perror("read");
+				}
+
+				continue;
+			}
+
+			idle++;
+			continue;
+		}
+
+		idle = 0;
+		last = now_seconds();
+
+		for (k = 0; k < n && !ring; k++)
+		{
+			touchpanel_release_event(device, events[k]);
+		}
+	}
+
+	elapsed = (threaded ? last : now_seconds()) - start;
+
+	touchpanel_get_read_stats(device, &syscalls, &delivered);
+	touchpanel_get_event_pool_stats(device, &allocated, &high_water);
+	touchpanel_get_stage_times(device, stage_ns, NUM_STAGES);
+
+	printf("raw events        %ld\n", raw_events);
+	printf("events delivered  %u\n", delivered);
+	printf("read syscalls     %u\n", syscalls);
+	printf("elapsed           %.3f ms\n", elapsed * 1e3);
+	printf("raw events/sec    %.0f\n", raw_events / elapsed);
+	printf("delivered/sec     %.0f\n", delivered / elapsed);
+	if (ring)
+	{
+		printf("ring frames read  %llu (%llu lost)\n",
+		       (unsigned long long) next - lost, (unsigned long long) lost);
+		munmap(ring, TOUCH_SHM_SIZE);
+	}
+
+	printf("pool allocations  %u (high water %u)\n", allocated, high_water);
+
+	for (i = 0; i < NUM_STAGES; i++)
+	{
+		printf("%-17s %llu ns total, %.1f ns/raw event\n", stage_names[i],
+		       (unsigned long long) stage_ns[i],
+		       raw_events ? (double) stage_ns[i] / raw_events : 0.0);
+	}
+
+	nyx_module_close(device);
+
+	if (path == trace)
+	{
+		unlink(trace);
+	}
+
+	return 0;
+}
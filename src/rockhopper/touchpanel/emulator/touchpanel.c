@@ -32,7 +32,7 @@
 #include <time.h>
 #include <glib.h>
 #include <errno.h>
-#include <poll.h>
+#include <unistd.h>
 
 #include <nyx/nyx_module.h>
 #include <nyx/module/nyx_event_touchpanel_internal.h>
@@ -46,6 +46,11 @@
 #include <fcntl.h>
 
 #include "touchpanel_gestures.h"
+#include "touchpanel_transform.h"
+#include "touchpanel_capture.h"
+#include "touchpanel_shm.h"
+#include "latency.h"
+#include "input_reader.h"
 
 /* Later versions of nyx_utils.h no longer define this macro */
 #undef return_if
@@ -56,28 +61,178 @@
     }                                                         \
   } while(0)
 
-typedef struct
-{
-	nyx_device_t _parent;
-	nyx_event_touchpanel_t *current_event_ptr;
-	int32_t mode;
-} touchpanel_device_t;
+#define MAX_HIDD_EVENTS     (4096 / sizeof(input_event_t))
 
-NYX_DECLARE_MODULE(NYX_DEVICE_TOUCHPANEL, "Touchpanel");
+/* Multitouch protocol B slots we keep track of */
+#define MAX_MT_SLOTS            NYX_MAX_TOUCH_EVENTS
 
-#define MAX_HIDD_EVENTS     (4096 / sizeof(input_event_t))
+/*
+ * Worst case number of events generated from a single raw input event: a
+ * protocol B frame may release a contact and report a new one in every slot,
+ * followed by the gestures recognized in it.
+ */
+#define MAX_EVENTS_PER_FRAME    (MAX_MT_SLOTS * 2 * MAX_EVENTS_PER_FINGER + 1 + \
+                                 MAX_GESTURE_EVENTS)
+
+/* Fingers reported by the single touch (mouse) emulation */
+#define MOUSE_MAX_FINGERS       1
+
+/* The tracker keeps twice as many fingers as it is told about */
+#define MAX_EVENTS_PER_MOUSE_FRAME  (MOUSE_MAX_FINGERS * 2 * MAX_EVENTS_PER_FINGER + 1 + \
+                                     MAX_GESTURE_EVENTS)
+
+/* Room for the events generated from a full ring of raw events */
+#define MAX_GENERATED_EVENTS    (MAX_HIDD_EVENTS * 4)
+
+#define MAX_STAGED_FRAMES       32
+#define MAX_STAGED_POINTS       (MAX_STAGED_FRAMES * 4)
 
 typedef struct
 {
 	size_t input_filled;
 	size_t input_read;
-	input_event_t input[MAX_HIDD_EVENTS];
+	input_event_t input[MAX_GENERATED_EVENTS];
 } event_list_t;
 
+/**
+ * Raw events drained from the evdev node, waiting to be fed through
+ * handle_new_event().
+ */
+typedef struct
+{
+	size_t head;
+	size_t count;
+	size_t partial;                 /**< bytes of an event a pipe cut short,
+	                                     kept at the tail */
+	input_event_t input[MAX_HIDD_EVENTS];
+} event_ring_t;
+
+#define EVENT_POOL_INITIAL_SIZE     4
+
+/**
+ * Touch event as allocated by the pool, with the kernel time of the input
+ * it was built from. A coalesced event keeps the time of its first frame.
+ */
+typedef struct
+{
+	nyx_event_touchpanel_t event;
+	struct timeval kernel_time;
+} touch_event_t;
+
+#define TOUCH_EVENT(event_ptr)  ((touch_event_t *) (event_ptr))
+
+/**
+ * Released touch events are kept here and handed out again, so steady state
+ * input does not go through the heap. The pool only grows when every event
+ * is in use.
+ */
+typedef struct
+{
+	nyx_event_touchpanel_t **free_events;   /**< stack of released events */
+	unsigned int free_count;
+	unsigned int capacity;      /**< size of the free_events stack */
+	unsigned int allocated;     /**< events owned by the pool */
+	unsigned int limit;         /**< most events allocated, 0 if unbounded */
+	unsigned int in_use;        /**< events currently handed out */
+	unsigned int high_water;    /**< maximum of in_use */
+} event_pool_t;
+
+/* Values of touchpanel_set_mode() */
+typedef enum
+{
+    TOUCHPANEL_MODE_FRAMES = 0,     /**< one event per panel frame */
+    TOUCHPANEL_MODE_COALESCE,       /**< one event per read, resampled to the
+                                         target time */
+    TOUCHPANEL_MODE_SHARED_RING,    /**< frames written to the shared ring, see
+                                         touchpanel_get_shared_ring() */
+    TOUCHPANEL_MODE_GESTURES,       /**< only NYX_TOUCHPANEL_EVENT_TYPE_GESTURE
+                                         events */
+} touchpanel_mode_t;
+
+typedef struct
+{
+	int x;
+	int y;
+	int64_t timestamp;
+	bool valid;
+} coalesce_sample_t;
+
+/* Stages of the pipeline timed when built with TOUCHPANEL_STAGE_TIMING */
+typedef enum
+{
+    STAGE_READ = 0,         /**< read() from the event node */
+    STAGE_DECODE,           /**< raw events to staged frames */
+    STAGE_GENERATE,         /**< transform and gesture tracking */
+    STAGE_DELIVER,          /**< generated events to nyx events */
+    NUM_STAGES
+} pipeline_stage_t;
+
+#ifdef TOUCHPANEL_STAGE_TIMING
+#define STAGE_BEGIN(start)  int64_t start = stage_clock()
+#define STAGE_END(device, stage, start) \
+	__atomic_fetch_add(&(device)->stage_ns[stage], stage_clock() - (start), \
+	                   __ATOMIC_RELAXED)
+#else
+#define STAGE_BEGIN(start)
+#define STAGE_END(device, stage, start)
+#endif
+
+typedef struct
+{
+	nyx_device_t _parent;
+	nyx_event_touchpanel_t *current_event_ptr;
+	int32_t mode;                   /**< touchpanel_mode_t, accessed atomically */
+	event_pool_t event_pool;
+	event_ring_t raw_events;
+	bool read_input;                /**< event node read since the last drain */
+	bool input_eof;                 /**< a replayed capture has ended */
+	bool out_of_events;             /**< input left unread for want of an event */
+	bool resync_pending;            /**< input dropped, skipping to SYN_REPORT */
+	unsigned int syn_dropped;       /**< kernel buffer overruns seen */
+	unsigned int read_syscalls;     /**< read() calls issued on the event node */
+	unsigned int frames_delivered;  /**< touch events handed out to the caller */
+	unsigned int frames_coalesced;  /**< frames folded into a previous event */
+	int64_t target_time;            /**< resampling target of coalesced events,
+	                                     accessed atomically */
+	nyx_event_touchpanel_t *held_event_ptr;   /**< frame read past a coalesced event */
+	coalesce_sample_t coalesce_prev[NYX_MAX_TOUCH_EVENTS];
+	latency_histogram_t latency;    /**< kernel event to delivery latency, only
+	                                     touched by the caller's thread */
+	uint64_t stage_ns[NUM_STAGES];  /**< time spent per pipeline stage */
+	bool threaded;                  /**< events are produced by the reader */
+	input_reader_t reader;
+	input_queue_t released;         /**< events handed back to the reader */
+	touch_shm_t shm;                /**< ring of TOUCHPANEL_MODE_SHARED_RING */
+} touchpanel_device_t;
+
+NYX_DECLARE_MODULE(NYX_DEVICE_TOUCHPANEL, "Touchpanel");
+
 
 event_list_t touchpanel_event_list;
 int touchpanel_event_fd = -1;
 
+/* Clock the kernel stamps touch events with */
+static clockid_t sEventClock = CLOCK_REALTIME;
+
+/* Capture file raw events are copied to, see NYX_TOUCHPANEL_RECORD */
+static int sRecordFd = -1;
+
+/* Environment variables naming a capture to replay instead of the panel,
+ * or to record the panel input to */
+#define TOUCHPANEL_REPLAY_ENV   "NYX_TOUCHPANEL_REPLAY"
+#define TOUCHPANEL_RECORD_ENV   "NYX_TOUCHPANEL_RECORD"
+
+#ifdef TOUCHPANEL_STAGE_TIMING
+static inline int64_t stage_clock(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+#endif
+
 static void touch_item_reset(nyx_touchpanel_event_item_t *t)
 {
 	t->finger = 0;
@@ -90,11 +245,117 @@ static void touch_item_reset(nyx_touchpanel_event_item_t *t)
 	t->weight = (double) NAN;
 }
 
-static nyx_event_touchpanel_t *touch_event_create()
+static int event_pool_init(event_pool_t *pool)
+{
+	pool->free_events = (nyx_event_touchpanel_t **) calloc(
+	                        sizeof(nyx_event_touchpanel_t *), EVENT_POOL_INITIAL_SIZE);
+
+	if (NULL == pool->free_events)
+	{
+		return -1;
+	}
+
+	pool->capacity = EVENT_POOL_INITIAL_SIZE;
+
+	while (pool->free_count < EVENT_POOL_INITIAL_SIZE)
+	{
+		nyx_event_touchpanel_t *event_ptr =
+		    (nyx_event_touchpanel_t *) calloc(sizeof(touch_event_t), 1);
+
+		if (NULL == event_ptr)
+		{
+			break;
+		}
+
+		pool->free_events[pool->free_count++] = event_ptr;
+		pool->allocated++;
+	}
+
+	return 0;
+}
+
+static void event_pool_deinit(event_pool_t *pool)
+{
+	while (pool->free_count > 0)
+	{
+		free(pool->free_events[--pool->free_count]);
+	}
+
+	if (pool->in_use)
+	{
+		nyx_warn("%u touch events still in use", pool->in_use);
+	}
+
+	free(pool->free_events);
+	pool->free_events = NULL;
+	pool->capacity = 0;
+}
+
+static nyx_event_touchpanel_t *event_pool_get(event_pool_t *pool)
 {
 	nyx_event_touchpanel_t *event_ptr;
-	event_ptr =
-	    (nyx_event_touchpanel_t *) calloc(sizeof(nyx_event_touchpanel_t), 1);
+
+	if (pool->free_count > 0)
+	{
+		event_ptr = pool->free_events[--pool->free_count];
+	}
+	else
+	{
+		if (pool->limit && pool->allocated == pool->limit)
+		{
+			return NULL;
+		}
+
+		/* make sure the event fits back onto the stack once released */
+		if (pool->allocated == pool->capacity)
+		{
+			unsigned int capacity = pool->capacity ? pool->capacity * 2 :
+			                        EVENT_POOL_INITIAL_SIZE;
+			nyx_event_touchpanel_t **free_events = (nyx_event_touchpanel_t **) realloc(
+			        pool->free_events, capacity * sizeof(nyx_event_touchpanel_t *));
+
+			if (NULL == free_events)
+			{
+				return NULL;
+			}
+
+			pool->free_events = free_events;
+			pool->capacity = capacity;
+		}
+
+		event_ptr = (nyx_event_touchpanel_t *) calloc(sizeof(touch_event_t), 1);
+
+		if (NULL == event_ptr)
+		{
+			return NULL;
+		}
+
+		__atomic_store_n(&pool->allocated, pool->allocated + 1, __ATOMIC_RELAXED);
+	}
+
+	pool->in_use++;
+
+	/* the statistics are read from other threads */
+	if (pool->in_use > pool->high_water)
+	{
+		__atomic_store_n(&pool->high_water, pool->in_use, __ATOMIC_RELAXED);
+	}
+
+	return event_ptr;
+}
+
+static void event_pool_put(event_pool_t *pool, nyx_event_touchpanel_t *event_ptr)
+{
+	assert(pool->free_count < pool->capacity);
+
+	pool->free_events[pool->free_count++] = event_ptr;
+	pool->in_use--;
+}
+
+static nyx_event_touchpanel_t *touch_event_create(touchpanel_device_t
+        *touch_device)
+{
+	nyx_event_touchpanel_t *event_ptr = event_pool_get(&touch_device->event_pool);
 
 	if (NULL == event_ptr)
 	{
@@ -118,11 +379,64 @@ nyx_error_t touchpanel_release_event(nyx_device_t *d, nyx_event_t *e)
 		return NYX_ERROR_INVALID_HANDLE;
 	}
 
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
 	nyx_event_touchpanel_t *a = (nyx_event_touchpanel_t *) e;
-	free(a);
+
+	/* the pool belongs to the reader thread, which takes the event back; it
+	 * never has more events than the queue holds, so the push succeeds */
+	if (touch_device->threaded)
+	{
+		bool queued = input_queue_push(&touch_device->released, a);
+
+		assert(queued);
+		(void) queued;
+		return NYX_ERROR_NONE;
+	}
+
+	event_pool_put(&touch_device->event_pool, a);
 	return NYX_ERROR_NONE;
 }
 
+static void reclaim_released_events(touchpanel_device_t *touch_device)
+{
+	nyx_event_touchpanel_t *event_ptr;
+
+	while (NULL != (event_ptr = input_queue_pop(&touch_device->released)))
+	{
+		event_pool_put(&touch_device->event_pool, event_ptr);
+	}
+}
+
+/*
+ * Events the reader thread lets out of the pool at a time, leaving room for
+ * those the module keeps while building the next one. The pool limit of
+ * INPUT_QUEUE_SIZE bounds them all, so every one fits in the release queue.
+ */
+#define READER_EVENTS_IN_FLIGHT (INPUT_QUEUE_SIZE - 2)
+
+/**
+ * Wait until the consumer has released enough events for the reader thread
+ * to build another one. Returns false once the thread has to stop.
+ */
+static bool reader_reserve_events(touchpanel_device_t *touch_device)
+{
+	int yields = 0;
+
+	reclaim_released_events(touch_device);
+
+	while (touch_device->event_pool.in_use >= READER_EVENTS_IN_FLIGHT)
+	{
+		if (!input_reader_backoff(&touch_device->reader, &yields))
+		{
+			return false;
+		}
+
+		reclaim_released_events(touch_device);
+	}
+
+	return true;
+}
+
 static nyx_touchpanel_event_item_t *touch_event_get_next_item(
     nyx_event_touchpanel_t *i_event_ptr)
 {
@@ -175,7 +489,7 @@ static inline int64_t get_ts_tval(struct timeval *tv)
 #define VBOXGUEST_IOCTL_CODE(Function, Size)   VBOXGUEST_IOCTL_CODE_((Function) | VBOXGUEST_IOCTL_FLAG, Size)
 #define VBOXGUEST_IOCTL_VMMREQUEST(Size)       VBOXGUEST_IOCTL_CODE(3, (Size))
 
-#pragma pack(4)
+#pragma pack(push, 4)
 /** generic VMMDev request header */
 typedef struct
 {
@@ -225,6 +539,7 @@ typedef struct VMMdev_req_mouse_pointer
 	/** Pointer data. */
 	char pointerData[4];
 } VMMdev_req_mouse_pointer;
+#pragma pack(pop)
 
 /* The purpose of this function is to enable mouse pointer on the screen
    for virtualbox qemux86 images, by firing appropriate ioctls to vbox driver */
@@ -314,10 +629,31 @@ error:
  * the fact that the XML file parsing reads in all the cypress-library
  * settings that we don't need or want (for dependency reasons)
  */
+#ifndef TOUCHPANEL_FILTER_MODE
+#define TOUCHPANEL_FILTER_MODE      FILTER_NONE
+#endif
+
+/* Look-ahead of reported moves, about one display refresh */
+#ifndef TOUCHPANEL_PREDICTION_MS
+#define TOUCHPANEL_PREDICTION_MS    0
+#endif
+
 static general_settings_t sGeneralSettings =
 {
 	.coordBufSize = 6,
-	.fingerDownThreshold = 0
+	.fingerDownThreshold = 0,
+	.filterMode = TOUCHPANEL_FILTER_MODE,
+	.filterMinCutoff = 1.0,
+	.filterBeta = 0.007,
+	.filterDCutoff = 1.0,
+	.predictionMs = TOUCHPANEL_PREDICTION_MS,
+	.gesturesEnabled = true,
+	.tapRadius = 20,
+	.tapTimeoutMs = 300,
+	.doubleTapMs = 300,
+	.longPressMs = 500,
+	.flickVelocity = 1000,
+	.pinchThreshold = 20
 };
 
 #define FRAMEBUF_DEVICE_NAME    "/dev/fb"
@@ -353,15 +689,115 @@ exit:
 }
 
 
-static float scaleX, scaleY;
+#ifndef TOUCHPANEL_CALIBRATION_FILE
+#define TOUCHPANEL_CALIBRATION_FILE "/etc/pointercal"
+#endif
+
+static touch_transform_t sTransform;
+
+/**
+ * State of a multitouch protocol B slot as reported by the kernel.
+ */
+typedef struct
+{
+	int32_t tracking_id;    /**< current kernel tracking id, -1 if unused */
+	int32_t reported_id;    /**< tracking id reported as down, -1 if none */
+	int x;                  /**< raw position */
+	int y;
+	int reported_x;         /**< raw position last reported */
+	int reported_y;
+	bool dirty;             /**< changed since the last EV_SYN */
+	coord_buf_t coords;     /**< history of reported display positions */
+	gesture_state_data_t gesture;   /**< recognizer state of the contact */
+} mt_slot_t;
+
+typedef struct
+{
+	bool enabled;
+	int current;            /**< slot addressed by ABS_MT_* events, -1 if ignored */
+	int num_slots;
+	mt_slot_t slots[MAX_MT_SLOTS];
+	coord_t *pCoordArena;   /**< backing store of the slot histories */
+} mt_state_t;
+
+static mt_state_t mt_state;
+
+#define BITS_PER_LONG           (sizeof(long) * 8)
+#define NBITS(x)                ((((x) - 1) / BITS_PER_LONG) + 1)
+#define TEST_BIT(bit, array)    ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+/**
+ * Set up the protocol B slot table and the per-slot position history.
+ */
+static void
+setup_mt_slots(int num_slots, int current)
+{
+	int i;
+
+	mt_state.pCoordArena = (coord_t *) calloc(MAX_MT_SLOTS *
+	                       sGeneralSettings.coordBufSize, sizeof(coord_t));
+
+	if (NULL == mt_state.pCoordArena)
+	{
+		nyx_error("Failed to allocate multitouch slot history");
+		return;
+	}
+
+	mt_state.enabled = true;
+	mt_state.current = current;
+	mt_state.num_slots = MIN(num_slots, MAX_MT_SLOTS);
+
+	for (i = 0; i < MAX_MT_SLOTS; i++)
+	{
+		mt_state.slots[i].tracking_id = -1;
+		mt_state.slots[i].reported_id = -1;
+		init_coord_buffer(&mt_state.slots[i].coords,
+		                  &mt_state.pCoordArena[i * sGeneralSettings.coordBufSize],
+		                  sGeneralSettings.coordBufSize);
+	}
+
+	nyx_debug("Using multitouch protocol B with %d slots", mt_state.num_slots);
+}
+
+/**
+ * Check whether the event node speaks multitouch protocol B and if so set up
+ * the slot table.
+ */
+static void
+init_mt_slots(void)
+{
+	unsigned long absbits[NBITS(ABS_CNT)];
+	struct input_absinfo abs;
+
+	memset(&mt_state, 0, sizeof(mt_state));
+
+	if (ioctl(touchpanel_event_fd, EVIOCGBIT(EV_ABS, sizeof(absbits)),
+	          absbits) < 0)
+	{
+		return;
+	}
+
+	if (!TEST_BIT(ABS_MT_SLOT, absbits) ||
+	        !TEST_BIT(ABS_MT_TRACKING_ID, absbits) ||
+	        ioctl(touchpanel_event_fd, EVIOCGABS(ABS_MT_SLOT), &abs) < 0)
+	{
+		return;
+	}
+
+	setup_mt_slots(abs.maximum + 1, abs.value);
+}
 
+/**
+ * Open the panel event node and fill in its geometry
+ */
 static int
-init_touchpanel(void)
+init_event_device(capture_header_t *pHeader)
 {
 	struct input_absinfo abs;
-	int  maxX, maxY, sXres, sYres, ret = -1;
+	int ret = -1;
+	int absX = ABS_X, absY = ABS_Y;
 
-	touchpanel_event_fd = open("/dev/input/touchscreen0", O_RDWR);
+	touchpanel_event_fd = open("/dev/input/touchscreen0", O_RDWR | O_NONBLOCK);
 
 	if (touchpanel_event_fd < 0)
 	{
@@ -369,7 +805,16 @@ init_touchpanel(void)
 		return -1;
 	}
 
-	ret = ioctl(touchpanel_event_fd, EVIOCGABS(0), &abs);
+	sEventClock = input_set_monotonic_clock(touchpanel_event_fd);
+	init_mt_slots();
+
+	if (mt_state.enabled)
+	{
+		absX = ABS_MT_POSITION_X;
+		absY = ABS_MT_POSITION_Y;
+	}
+
+	ret = ioctl(touchpanel_event_fd, EVIOCGABS(absX), &abs);
 
 	if (ret < 0)
 	{
@@ -377,9 +822,9 @@ init_touchpanel(void)
 		goto error;
 	}
 
-	maxX = abs.maximum;
+	pHeader->panelMaxX = abs.maximum;
 
-	ret = ioctl(touchpanel_event_fd, EVIOCGABS(1), &abs);
+	ret = ioctl(touchpanel_event_fd, EVIOCGABS(absY), &abs);
 
 	if (ret < 0)
 	{
@@ -387,33 +832,96 @@ init_touchpanel(void)
 		goto error;
 	}
 
-	maxY = abs.maximum;
+	pHeader->panelMaxY = abs.maximum;
+	pHeader->mtSlots = mt_state.num_slots;
 
 	// The following function is valid only for virtualbox qemux86 image
 	init_vbox_touchpanel();
-	init_gesture_state_machine(&sGeneralSettings, 1);
 
 	/* Get the display resolution */
-	if (get_display_res(&sXres, &sYres) < 0)
+	ret = get_display_res(&pHeader->displayX, &pHeader->displayY);
+
+	if (ret < 0)
 	{
 		nyx_error("Failed to get display resolution");
 		goto error;
 	}
 
-	scaleX = (float)sXres / (float)maxX;
-	scaleY = (float)sYres / (float)maxY;
-
 	return 0;
 error:
 
 	if (touchpanel_event_fd >= 0)
 	{
 		close(touchpanel_event_fd);
+		touchpanel_event_fd = -1;
 	}
 
 	return ret;
 }
 
+/**
+ * Read the panel input from a capture instead, its header provides the
+ * geometry the event node and the framebuffer would
+ */
+static int
+init_replay(const char *pPath, capture_header_t *pHeader)
+{
+	touchpanel_event_fd = capture_open_replay(pPath, pHeader);
+
+	if (touchpanel_event_fd < 0)
+	{
+		return -1;
+	}
+
+	memset(&mt_state, 0, sizeof(mt_state));
+
+	if (pHeader->mtSlots > 0)
+	{
+		setup_mt_slots(pHeader->mtSlots, 0);
+	}
+
+	nyx_info("Replaying touchpanel input from %s", pPath);
+
+	return 0;
+}
+
+static int
+init_touchpanel(void)
+{
+	capture_header_t header;
+	const char *replay = getenv(TOUCHPANEL_REPLAY_ENV);
+	const char *record = getenv(TOUCHPANEL_RECORD_ENV);
+
+	memset(&header, 0, sizeof(header));
+
+	if ((replay ? init_replay(replay, &header) : init_event_device(&header)) < 0)
+	{
+		return -1;
+	}
+
+	init_gesture_state_machine(&sGeneralSettings, MOUSE_MAX_FINGERS);
+
+	transform_init_scale(&sTransform, header.panelMaxX, header.panelMaxY,
+	                     header.displayX, header.displayY);
+
+	/* a replay only depends on its capture */
+	if (!replay &&
+	        transform_load_calibration(&sTransform, TOUCHPANEL_CALIBRATION_FILE) == 0)
+	{
+		nyx_debug("Using touchpanel calibration from %s",
+		          TOUCHPANEL_CALIBRATION_FILE);
+	}
+
+	if (record)
+	{
+		sRecordFd = capture_open_record(record, &header);
+	}
+
+	return 0;
+}
+
+
+static void *touchpanel_reader_thread(void *arg);
 
 nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 {
@@ -426,6 +934,12 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 		return NYX_ERROR_OUT_OF_MEMORY;
 	}
 
+	if (event_pool_init(&touchpanel_device->event_pool) < 0)
+	{
+		free(touchpanel_device);
+		return NYX_ERROR_OUT_OF_MEMORY;
+	}
+
 
 	int ret = nyx_module_register_method(i, (nyx_device_t *) touchpanel_device,
 	                                     NYX_GET_EVENT_SOURCE_MODULE_METHOD, "touchpanel_get_event_source");
@@ -453,16 +967,34 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 	nyx_module_register_method(i, (nyx_device_t *) touchpanel_device,
 	                           NYX_TOUCHPANEL_GET_MODE_MODULE_METHOD, "touchpanel_get_mode");
 
-	*d = (nyx_device_t *) touchpanel_device;
-
 	if (init_touchpanel() < 0)
 	{
-		goto fail_unlock_settings;
+		goto fail_init;
+	}
+
+	if (input_reader_enabled())
+	{
+		touchpanel_device->threaded = true;
+		touchpanel_device->event_pool.limit = INPUT_QUEUE_SIZE;
+
+		if (input_reader_start(&touchpanel_device->reader, touchpanel_reader_thread,
+		                       touchpanel_device) < 0)
+		{
+			touchpanel_device->threaded = false;
+			touchpanel_device->event_pool.limit = 0;
+		}
 	}
 
+	*d = (nyx_device_t *) touchpanel_device;
+
 	return NYX_ERROR_NONE;
 
-fail_unlock_settings:
+fail_init:
+	/* the device node is closed already, the slots may have been set up */
+	free(mt_state.pCoordArena);
+	memset(&mt_state, 0, sizeof(mt_state));
+	event_pool_deinit(&touchpanel_device->event_pool);
+	free(touchpanel_device);
 	return NYX_ERROR_GENERIC;
 }
 
@@ -470,17 +1002,54 @@ nyx_error_t nyx_module_close(nyx_device_t *d)
 {
 
 	touchpanel_device_t *touchpanel_device = (touchpanel_device_t *) d;
+	nyx_event_touchpanel_t *event_ptr;
 
-	if (touchpanel_device->current_event_ptr)
+	if (touchpanel_device->threaded)
 	{
-		touchpanel_release_event(d,
-		                         (nyx_event_t *) touchpanel_device->current_event_ptr);
-	}
+		input_reader_stop(&touchpanel_device->reader);
+		touchpanel_device->threaded = false;
 
-	nyx_debug("Freeing touchpanel %p", d);
+		while (NULL != (event_ptr = input_queue_pop(&touchpanel_device->reader.ready)))
+		{
+			event_pool_put(&touchpanel_device->event_pool, event_ptr);
+		}
 
-	deinit_gesture_state_machine();
-	free(d);
+		reclaim_released_events(touchpanel_device);
+	}
+
+	if (touchpanel_device->shm.pRing)
+	{
+		touch_shm_destroy(&touchpanel_device->shm);
+	}
+
+	if (touchpanel_device->current_event_ptr)
+	{
+		touchpanel_release_event(d,
+		                         (nyx_event_t *) touchpanel_device->current_event_ptr);
+	}
+
+	if (touchpanel_device->held_event_ptr)
+	{
+		touchpanel_release_event(d,
+		                         (nyx_event_t *) touchpanel_device->held_event_ptr);
+	}
+
+	nyx_debug("Freeing touchpanel %p (%u read syscalls for %u frames, %u coalesced, "
+	          "%u drops)", d, touchpanel_device->read_syscalls,
+	          touchpanel_device->frames_delivered, touchpanel_device->frames_coalesced,
+	          touchpanel_device->syn_dropped);
+
+	deinit_gesture_state_machine();
+	free(mt_state.pCoordArena);
+	memset(&mt_state, 0, sizeof(mt_state));
+	event_pool_deinit(&touchpanel_device->event_pool);
+	free(d);
+
+	if (sRecordFd >= 0)
+	{
+		close(sRecordFd);
+		sRecordFd = -1;
+	}
 
 	if (touchpanel_event_fd >= 0)
 	{
@@ -505,7 +1074,10 @@ nyx_error_t touchpanel_get_event_source(nyx_device_t *d, int *f)
 		return NYX_ERROR_INVALID_VALUE;
 	}
 
-	*f = touchpanel_event_fd;
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+
+	*f = touch_device->threaded ? touch_device->reader.wake_fd :
+	     touchpanel_event_fd;
 
 	return NYX_ERROR_NONE;
 }
@@ -519,28 +1091,99 @@ nyx_error_t touchpanel_set_operating_mode(nyx_device_t *d,
 void
 get_time_stamp(time_stamp_t *pTime)
 {
-	struct timeval tv;
-	(void)gettimeofday(&tv, NULL);
-
-	pTime->time.tv_sec = tv.tv_sec;
-	pTime->time.tv_nsec = tv.tv_usec * 1000;
+	clock_gettime(sEventClock, &pTime->time);
 }
 
 
+typedef enum
+{
+    FRAME_MOUSE = 0,        /**< single touch emulation frame */
+    FRAME_MT,               /**< protocol B frame */
+    FRAME_FORWARD,          /**< event passed on unchanged */
+} frame_kind_t;
+
+typedef struct
+{
+	frame_kind_t kind;
+	struct timeval time;
+	int first_point;        /**< index of the first point of the frame */
+	int num_points;
+	int touching;           /**< FRAME_MOUSE: button state */
+	input_event_t forward;  /**< FRAME_FORWARD: event to pass on */
+} staged_frame_t;
+
+typedef struct
+{
+	int32_t id;             /**< finger / tracking id */
+	int slot;               /**< protocol B slot of the contact */
+	bool down;              /**< report a touch down before the position */
+	bool up;                /**< report a touch up after the position */
+} staged_contact_t;
+
+/**
+ * Frames decoded from a batch of raw events. Points are stored raw and are
+ * transformed to display coordinates all at once before the frames are
+ * turned into touch events.
+ */
+typedef struct
+{
+	int num_frames;
+	int num_points;
+	int num_events;         /**< upper bound of events generated on flush */
+	staged_frame_t frames[MAX_STAGED_FRAMES];
+	staged_contact_t contacts[MAX_STAGED_POINTS];
+	int32_t x[MAX_STAGED_POINTS];
+	int32_t y[MAX_STAGED_POINTS];
+} frame_batch_t;
+
+static frame_batch_t staged;
+
 int cachedX, cachedY;
 
+static staged_frame_t *
+stage_frame(frame_kind_t kind, const struct timeval *time, int num_points,
+            int num_events)
+{
+	staged_frame_t *frame = &staged.frames[staged.num_frames++];
+
+	assert(staged.num_frames <= MAX_STAGED_FRAMES);
+	assert(staged.num_points + num_points <= MAX_STAGED_POINTS);
+
+	frame->kind = kind;
+	frame->time = *time;
+	frame->first_point = staged.num_points;
+	frame->num_points = num_points;
+	staged.num_events += num_events;
+
+	return frame;
+}
+
+static void
+stage_mouse_frame(const struct timeval *time, int touchButtonState)
+{
+	staged_frame_t *frame = stage_frame(FRAME_MOUSE, time, 1,
+	                                    MAX_EVENTS_PER_MOUSE_FRAME);
+
+	frame->touching = touchButtonState;
+	staged.x[frame->first_point] = cachedX;
+	staged.y[frame->first_point] = cachedY;
+	staged.num_points++;
+}
+
 static void
-generate_mouse_gesture(int touchButtonState)
+generate_mouse_gesture(const staged_frame_t *frame)
 {
 	int32_t xOrd[2], yOrd[2], wOrd[2], fingers;
 	time_stamp_t eventTime;
-	int num_events = 0;
+	int num_events = touchpanel_event_list.input_filled / sizeof(input_event_t);
 
-	get_time_stamp(&eventTime);
-	xOrd[0] = cachedX;
-	yOrd[0] = cachedY;
-	wOrd[0] = touchButtonState ? 1 : 0;
-	fingers = touchButtonState ? 1 : 0;
+	/* stamp with the sample time, batched frames are generated together */
+	eventTime.time.tv_sec = frame->time.tv_sec;
+	eventTime.time.tv_nsec = frame->time.tv_usec * 1000;
+	xOrd[0] = staged.x[frame->first_point];
+	yOrd[0] = staged.y[frame->first_point];
+	wOrd[0] = frame->touching ? 1 : 0;
+	fingers = frame->touching ? 1 : 0;
 
 	xOrd[1] = 0;
 	yOrd[1] = 0;
@@ -549,7 +1192,6 @@ generate_mouse_gesture(int touchButtonState)
 	gesture_state_machine(xOrd, yOrd, wOrd, fingers, &eventTime,
 	                      touchpanel_event_list.input, &num_events);
 	touchpanel_event_list.input_filled = num_events * sizeof(input_event_t);
-	touchpanel_event_list.input_read = 0;
 }
 
 
@@ -560,19 +1202,268 @@ generate_mouse_gesture(int touchButtonState)
 #define SYN_START       8
 
 
+static void
+fill_event(input_event_t *event, const struct timeval *time, uint16_t type,
+           uint16_t code, int32_t value)
+{
+	event->time = *time;
+	event->type = type;
+	event->code = code;
+	event->value = value;
+}
+
+static void
+stage_contact(int slot, int32_t id, int x, int y, bool down, bool up)
+{
+	int i = staged.num_points++;
+
+	staged.contacts[i].slot = slot;
+	staged.contacts[i].id = id;
+	staged.contacts[i].down = down;
+	staged.contacts[i].up = up;
+	staged.x[i] = x;
+	staged.y[i] = y;
+}
+
+/**
+ * Stage every protocol B slot that changed since the last EV_SYN. The
+ * kernel already tracks finger identity, so the software matcher in
+ * gesture_state_machine() is bypassed.
+ */
+static void
+stage_mt_frame(input_event_t *syn_event)
+{
+	staged_frame_t *frame = stage_frame(FRAME_MT, &syn_event->time, 0, 0);
+	int i;
+
+	for (i = 0; i < mt_state.num_slots; i++)
+	{
+		mt_slot_t *slot = &mt_state.slots[i];
+
+		if (!slot->dirty)
+		{
+			continue;
+		}
+
+		/* the contact in this slot is gone or was replaced */
+		if (slot->reported_id >= 0 && slot->reported_id != slot->tracking_id)
+		{
+			stage_contact(i, slot->reported_id, slot->reported_x, slot->reported_y,
+			              false, true);
+			slot->reported_id = -1;
+			staged.num_events += MAX_EVENTS_PER_FINGER - 1;
+		}
+
+		if (slot->tracking_id >= 0)
+		{
+			bool down = (slot->reported_id < 0);
+
+			stage_contact(i, slot->tracking_id, slot->x, slot->y, down, false);
+			slot->reported_id = slot->tracking_id;
+			slot->reported_x = slot->x;
+			slot->reported_y = slot->y;
+			staged.num_events += MAX_EVENTS_PER_FINGER - 1;
+		}
+
+		slot->dirty = false;
+	}
+
+	frame->num_points = staged.num_points - frame->first_point;
+
+	if (frame->num_points > 0)
+	{
+		staged.num_events += 1 + MAX_GESTURE_EVENTS;
+	}
+	else
+	{
+		staged.num_frames--;
+	}
+}
+
+static void
+generate_mt_frame(const staged_frame_t *frame)
+{
+	int num_events = touchpanel_event_list.input_filled / sizeof(input_event_t);
+	int first_event = num_events;
+	input_event_t *events = touchpanel_event_list.input;
+	const struct timeval *time = &frame->time;
+	time_stamp_t timestamp;
+	int x, y, xVelocity, yVelocity;
+	int i;
+
+	timestamp.time.tv_sec = time->tv_sec;
+	timestamp.time.tv_nsec = time->tv_usec * 1000;
+
+	for (i = frame->first_point; i < frame->first_point + frame->num_points; i++)
+	{
+		staged_contact_t *contact = &staged.contacts[i];
+		mt_slot_t *slot = &mt_state.slots[contact->slot];
+		coord_buf_t *coords = &slot->coords;
+
+		fill_event(&events[num_events++], time, EV_FINGERID, 0, contact->id);
+
+		if (contact->down)
+		{
+			fill_event(&events[num_events++], time, EV_KEY, BTN_TOUCH, 1);
+			reset_coord_buffer(coords);
+		}
+
+		if (!contact->up)
+		{
+			update_coord_buffer(coords, staged.x[i], staged.y[i], &timestamp);
+		}
+
+		gesture_recognizer_finger(&slot->gesture, contact->id, coords, contact->down,
+		                          contact->up, &timestamp);
+
+		get_velocity(coords, &xVelocity, &yVelocity);
+		get_predicted_coords(coords, (contact->down || contact->up) ? 0 :
+		                     sGeneralSettings.predictionMs, &x, &y);
+
+		fill_event(&events[num_events++], time, EV_ABS, ABS_X, x);
+		fill_event(&events[num_events++], time, EV_ABS, ABS_Y, y);
+		fill_event(&events[num_events++], time, EV_VELOCITY, X_DIM, xVelocity);
+		fill_event(&events[num_events++], time, EV_VELOCITY, Y_DIM, yVelocity);
+
+		if (contact->up)
+		{
+			fill_event(&events[num_events++], time, EV_KEY, BTN_TOUCH, 0);
+		}
+	}
+
+	if (first_event < num_events)
+	{
+		fill_event(&events[num_events++], time, EV_SYN, SYN_REPORT, 0);
+	}
+	gesture_recognizer_frame(&timestamp, events, &num_events);
+
+	touchpanel_event_list.input_filled = num_events * sizeof(input_event_t);
+}
+
+static void
+generate_forward_frame(const staged_frame_t *frame)
+{
+	int num_events = touchpanel_event_list.input_filled / sizeof(input_event_t);
+
+	memcpy(&touchpanel_event_list.input[num_events], &frame->forward,
+	       sizeof(input_event_t));
+	// Forward an EV_SYN after the key event, to make sure it is processed immediately.
+	fill_event(&touchpanel_event_list.input[num_events + 1], &frame->forward.time,
+	           EV_SYN, SYN_START, 0);
+
+	touchpanel_event_list.input_filled = (num_events + 2) * sizeof(input_event_t);
+}
+
+/**
+ * Transform all staged points to display coordinates in one go, then turn
+ * the staged frames into events.
+ */
+static void
+flush_staged_frames(void)
+{
+	int i;
+
+	transform_points(&sTransform, staged.x, staged.y, staged.num_points);
+
+	for (i = 0; i < staged.num_frames; i++)
+	{
+		const staged_frame_t *frame = &staged.frames[i];
+
+		switch (frame->kind)
+		{
+			case FRAME_MOUSE:
+				generate_mouse_gesture(frame);
+				break;
+
+			case FRAME_MT:
+				generate_mt_frame(frame);
+				break;
+
+			case FRAME_FORWARD:
+				generate_forward_frame(frame);
+				break;
+		}
+	}
+
+	staged.num_frames = 0;
+	staged.num_points = 0;
+	staged.num_events = 0;
+}
+
+static void
+handle_mt_event(input_event_t *event)
+{
+	mt_slot_t *slot;
+
+	if (event->code == ABS_MT_SLOT)
+	{
+		mt_state.current = (event->value >= 0 &&
+		                    event->value < mt_state.num_slots) ? event->value : -1;
+		return;
+	}
+
+	if (mt_state.current < 0)
+	{
+		return;
+	}
+
+	slot = &mt_state.slots[mt_state.current];
+
+	switch (event->code)
+	{
+		case ABS_MT_TRACKING_ID:
+			slot->tracking_id = event->value;
+			slot->dirty = true;
+			break;
+
+		case ABS_MT_POSITION_X:
+			slot->x = event->value;
+			slot->dirty = true;
+			break;
+
+		case ABS_MT_POSITION_Y:
+			slot->y = event->value;
+			slot->dirty = true;
+			break;
+
+		default:
+			break;
+	}
+}
+
+static int touchButtonState = 0;
+
 static void handle_new_event(input_event_t *event)
 {
-	static int touchButtonState = 0;
+	if (mt_state.enabled)
+	{
+		// Single touch emulation events are ignored, the slots carry it all
+		if (event->type == EV_ABS && event->code >= ABS_MT_SLOT)
+		{
+			handle_mt_event(event);
+			return;
+		}
+		else if (event->type == EV_SYN)
+		{
+			stage_mt_frame(event);
+			return;
+		}
+		else if ((event->type == EV_ABS) || (event->type == EV_KEY &&
+		                                     event->code == BTN_TOUCH))
+		{
+			return;
+		}
+	}
 
-	// Truncate scaled X & Y coordinate values
+	// Raw X & Y coordinate values, transformed when the frame is flushed
 	if ((event->type == EV_ABS) && (event->code == ABS_X))
 	{
-		cachedX = (int)(event->value * scaleX);
+		cachedX = event->value;
 	}
 
 	else if ((event->type == EV_ABS) && (event->code == ABS_Y))
 	{
-		cachedY = (int)(event->value * scaleY);
+		cachedY = event->value;
 	}
 
 	// qemu touchpanel sends BTN_TOUCH, virtualbox touchpanel sends BTN_LEFT
@@ -589,12 +1480,12 @@ static void handle_new_event(input_event_t *event)
 			* button has been down in the same spot and not create flicks
 			* if it has been down for long enough
 			*/
-			generate_mouse_gesture(1);
+			stage_mouse_frame(&event->time, 1);
 		}
 	}
 	else if (event->type == EV_SYN)
 	{
-		generate_mouse_gesture(touchButtonState);
+		stage_mouse_frame(&event->time, touchButtonState);
 	}
 
 	if ((event->type == EV_REL && event->code == REL_WHEEL) ||
@@ -603,128 +1494,394 @@ static void handle_new_event(input_event_t *event)
 	                                   event->code == BTN_EXTRA || event->code == BTN_FORWARD ||
 	                                   event->code == BTN_BACK || event->code == BTN_TASK)))
 	{
-		memcpy(&touchpanel_event_list.input[0], event, sizeof(input_event_t));
-		// Forward an EV_SYN after the key event, to make sure it is processed immediately.
-		input_event_t syn_event;
-		syn_event.type = EV_SYN;
-		syn_event.code = SYN_START;
-		syn_event.value = 0;
-
-		memcpy(&touchpanel_event_list.input[1], &syn_event, sizeof(input_event_t));
-
-		touchpanel_event_list.input_filled = 2 * sizeof(input_event_t);
-		touchpanel_event_list.input_read = 0;
+		staged_frame_t *frame = stage_frame(FRAME_FORWARD, &event->time, 0, 2);
+		frame->forward = *event;
 	}
 
 	return;
 }
 
-static struct pollfd fds[1];
-
+/**
+ * Drain as many raw events as fit into the free space of the ring with a
+ * single read() on the (non-blocking) event node.
+ *
+ * @retval number of events read, 0 if none were pending, -1 on error
+ */
 static int
-read_input_event(void)
+read_input_events(touchpanel_device_t *touch_device)
 {
-	int numEvents = 0;
-	int rd = 0;
-	input_event_t pEvent;
-
-	fds[0].fd = touchpanel_event_fd;
-	fds[0].events = POLLIN;
+	event_ring_t *ring = &touch_device->raw_events;
+	size_t tail, space, events;
+	char *dest;
+	ssize_t rd;
 
-	int ret_val = poll(fds, 1, 0);
-
-	if (ret_val <= 0)
+	if (ring->count == MAX_HIDD_EVENTS)
 	{
 		return 0;
 	}
 
-	if (fds[0].revents & POLLIN)
+	/* a drained ring is filled from the start, in one read */
+	if (ring->count == 0)
+	{
+		memmove(&ring->input[0], &ring->input[ring->head], ring->partial);
+		ring->head = 0;
+	}
+
+	tail = (ring->head + ring->count) % MAX_HIDD_EVENTS;
+
+	/* only fill the contiguous part, the rest is picked up next time */
+	space = (tail >= ring->head) ? MAX_HIDD_EVENTS - tail : ring->head - tail;
+	dest = (char *) &ring->input[tail] + ring->partial;
+
+	do
 	{
-		rd = read(fds[0].fd, &pEvent, sizeof(input_event_t));
+		rd = read(touchpanel_event_fd, dest,
+		          space * sizeof(input_event_t) - ring->partial);
+		__atomic_fetch_add(&touch_device->read_syscalls, 1, __ATOMIC_RELAXED);
+	}
+	while (rd < 0 && errno == EINTR);
 
-		if (rd < 0 && errno != EINTR)
+	if (rd < 0)
+	{
+		if (errno == EAGAIN)
 		{
-			nyx_error("Failed to read events from keypad event file");
-			return -1;
+			return 0;
 		}
 
-		handle_new_event(&pEvent);
+		nyx_error("Failed to read events from touchpanel event file");
+		return -1;
+	}
+
+	/* only a replayed capture ends, the event node never does */
+	if (rd == 0)
+	{
+		touch_device->input_eof = true;
+	}
+
+	if (sRecordFd >= 0 && rd > 0 &&
+	        write(sRecordFd, dest, rd) != rd)
+	{
+		nyx_error("Failed to record touchpanel input, recording stopped");
+		close(sRecordFd);
+		sRecordFd = -1;
 	}
 
-	return numEvents;
+	/* a replayed pipe may cut an event short, its start waits for the rest */
+	events = (ring->partial + rd) / sizeof(input_event_t);
+	ring->partial = (ring->partial + rd) % sizeof(input_event_t);
+	ring->count += events;
+
+	return events;
 }
 
-nyx_error_t touchpanel_get_event(nyx_device_t *d, nyx_event_t **e)
+/**
+ * Fetch the value of an ABS_MT_* axis for every slot
+ */
+static bool
+query_mt_slot_values(uint32_t code, int32_t *values)
 {
-	int event_count = 0;
-	int event_iter = 0;
-	static int read_input = 0;
+	int32_t request[MAX_MT_SLOTS + 1];
 
-	nyx_event_t *p_generated = NULL;
-	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+	request[0] = code;
 
-	/*
-	 * Event bookkeeping...
-	 */
-	if (!read_input)
+	if (ioctl(touchpanel_event_fd, EVIOCGMTSLOTS(sizeof(request)), request) < 0)
 	{
-		read_input_event();
-		touch_device->current_event_ptr = NULL;
-		read_input = 1;
+		return false;
 	}
 
-	/*
-	* Event bookkeeping...
-	*/
-	event_count = touchpanel_event_list.input_filled / sizeof(input_event_t);
-	event_iter = touchpanel_event_list.input_read / sizeof(input_event_t);
+	memcpy(values, &request[1], mt_state.num_slots * sizeof(int32_t));
+
+	return true;
+}
+
+/**
+ * Bring the slot table in line with the kernel after dropped input and stage
+ * the differences as a frame, so contacts that went away are lifted and new
+ * ones put down. If the state can't be queried, as when replaying a capture,
+ * every contact is lifted rather than left stuck down.
+ */
+static void
+resync_mt_slots(input_event_t *syn_event)
+{
+	int32_t ids[MAX_MT_SLOTS], xs[MAX_MT_SLOTS], ys[MAX_MT_SLOTS];
+	struct input_absinfo abs;
+	bool queried;
+	int i;
+
+	queried = query_mt_slot_values(ABS_MT_TRACKING_ID, ids) &&
+	          query_mt_slot_values(ABS_MT_POSITION_X, xs) &&
+	          query_mt_slot_values(ABS_MT_POSITION_Y, ys);
 
-	if (event_iter == event_count)
+	for (i = 0; i < mt_state.num_slots; i++)
 	{
-		read_input = 0;
+		mt_slot_t *slot = &mt_state.slots[i];
+
+		slot->tracking_id = queried ? ids[i] : -1;
+
+		if (queried)
+		{
+			slot->x = xs[i];
+			slot->y = ys[i];
+		}
+
+		slot->dirty = (slot->tracking_id >= 0 || slot->reported_id >= 0);
 	}
 
-	if (touch_device->current_event_ptr == NULL)
+	if (ioctl(touchpanel_event_fd, EVIOCGABS(ABS_MT_SLOT), &abs) == 0)
 	{
-		/*
-		* let's allocate new event and hold it here.
-		*/
-		touch_device->current_event_ptr = touch_event_create();
+		mt_state.current = (abs.value >= 0 &&
+		                    abs.value < mt_state.num_slots) ? abs.value : -1;
 	}
 
-	touch_device->current_event_ptr->_parent.type = NYX_EVENT_TOUCHPANEL;
+	stage_mt_frame(syn_event);
+}
 
-	for (; event_iter < event_count; event_iter++)
-	{
-		input_event_t *input_event_ptr;
-		nyx_touchpanel_event_item_t *item_ptr;
-		input_event_ptr = &touchpanel_event_list.input[event_iter];
+/**
+ * Single touch counterpart of resync_mt_slots(), releasing the contact
+ * when its state can't be queried
+ */
+static void
+resync_single_touch(input_event_t *syn_event)
+{
+	unsigned long keys[NBITS(KEY_CNT)];
+	struct input_absinfo abs;
+	int touching = 0;
 
-		touchpanel_event_list.input_read += sizeof(input_event_t);
+	if (ioctl(touchpanel_event_fd, EVIOCGKEY(sizeof(keys)), keys) >= 0)
+	{
+		touching = TEST_BIT(BTN_TOUCH, keys) || TEST_BIT(BTN_LEFT, keys);
+	}
 
-		switch (input_event_ptr->type)
-		{
-			case EV_FINGERID:
-				item_ptr = touch_event_get_next_item(
-				               touch_device->current_event_ptr);
+	if (ioctl(touchpanel_event_fd, EVIOCGABS(ABS_X), &abs) == 0)
+	{
+		cachedX = abs.value;
+	}
 
-				if (NULL == item_ptr)
-				{
-					p_generated = (nyx_event_t *) touch_device->current_event_ptr;
-					touch_device->current_event_ptr = touch_event_create();
-					item_ptr = touch_event_get_next_item(
-					               touch_device->current_event_ptr);
-				}
+	if (ioctl(touchpanel_event_fd, EVIOCGABS(ABS_Y), &abs) == 0)
+	{
+		cachedY = abs.value;
+	}
 
-				if (NULL != item_ptr)
-				{
-					touch_item_reset(item_ptr);
-					item_ptr->finger = input_event_ptr->value * 1000
-					                   + input_event_ptr->code;
-					item_ptr->timestamp = get_ts_tval(&(input_event_ptr->time));
-				}
+	/* a missed release is reported the way handle_new_event() does */
+	if (touchButtonState && !touching)
+	{
+		stage_mouse_frame(&syn_event->time, 1);
+	}
 
-				break;
+	touchButtonState = touching;
+	stage_mouse_frame(&syn_event->time, touchButtonState);
+}
+
+/**
+ * Handle the kernel's SYN_DROPPED: the frame in progress is incomplete and
+ * everything up to the next SYN_REPORT is discarded, after which the
+ * device state is read back. Returns true if the event was consumed here.
+ */
+static bool
+handle_dropped_input(touchpanel_device_t *touch_device, input_event_t *event)
+{
+	int i;
+
+	if (event->type == EV_SYN && event->code == SYN_DROPPED)
+	{
+		if (!touch_device->resync_pending)
+		{
+			__atomic_fetch_add(&touch_device->syn_dropped, 1, __ATOMIC_RELAXED);
+			nyx_warn("Touchpanel input dropped, resynchronizing");
+		}
+
+		/* forget the partial frame, the resync restores what it changed */
+		for (i = 0; i < mt_state.num_slots; i++)
+		{
+			mt_state.slots[i].dirty = false;
+		}
+
+		touch_device->resync_pending = true;
+		return true;
+	}
+
+	if (!touch_device->resync_pending)
+	{
+		return false;
+	}
+
+	if (event->type == EV_SYN && event->code == SYN_REPORT)
+	{
+		touch_device->resync_pending = false;
+
+		if (mt_state.enabled)
+		{
+			resync_mt_slots(event);
+		}
+		else
+		{
+			resync_single_touch(event);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Feed buffered raw events through handle_new_event() until either the ring
+ * runs dry or there is no room left for another generated frame.
+ */
+static void
+process_input_events(touchpanel_device_t *touch_device)
+{
+	event_ring_t *ring = &touch_device->raw_events;
+	STAGE_BEGIN(decode_start);
+
+	while (ring->count > 0)
+	{
+		size_t filled = touchpanel_event_list.input_filled / sizeof(input_event_t);
+
+		/* make sure whatever the next event stages still fits */
+		if (staged.num_frames + 2 > MAX_STAGED_FRAMES ||
+		        staged.num_points + 2 * MAX_MT_SLOTS > MAX_STAGED_POINTS ||
+		        filled + staged.num_events + MAX_EVENTS_PER_FRAME > MAX_GENERATED_EVENTS)
+		{
+			break;
+		}
+
+		if (!handle_dropped_input(touch_device, &ring->input[ring->head]))
+		{
+			handle_new_event(&ring->input[ring->head]);
+		}
+
+		ring->head = (ring->head + 1) % MAX_HIDD_EVENTS;
+		ring->count--;
+	}
+
+	STAGE_END(touch_device, STAGE_DECODE, decode_start);
+
+	STAGE_BEGIN(generate_start);
+	flush_staged_frames();
+	STAGE_END(touch_device, STAGE_GENERATE, generate_start);
+}
+
+/**
+ * Build the next touch event, one per EV_SYN frame, reading the event node
+ * once all previously read input has been delivered. Returns NULL when no
+ * more input is available.
+ */
+static nyx_event_t *
+touchpanel_next_frame(touchpanel_device_t *touch_device)
+{
+	int event_count = 0;
+	int event_iter = 0;
+
+	nyx_event_t *p_generated = NULL;
+
+	/*
+	 * Event bookkeeping...
+	 */
+	if (touchpanel_event_list.input_read == touchpanel_event_list.input_filled)
+	{
+		touchpanel_event_list.input_filled = 0;
+		touchpanel_event_list.input_read = 0;
+
+		/*
+		 * Only go back to the kernel once everything drained by the previous
+		 * read has been delivered.
+		 */
+		if (touch_device->raw_events.count == 0 && !touch_device->read_input)
+		{
+			STAGE_BEGIN(read_start);
+			read_input_events(touch_device);
+			STAGE_END(touch_device, STAGE_READ, read_start);
+			touch_device->read_input = true;
+		}
+
+		process_input_events(touch_device);
+
+		if (touchpanel_event_list.input_filled == 0)
+		{
+			touch_device->read_input = false;
+			return NULL;
+		}
+	}
+
+	STAGE_BEGIN(deliver_start);
+	event_count = touchpanel_event_list.input_filled / sizeof(input_event_t);
+	event_iter = touchpanel_event_list.input_read / sizeof(input_event_t);
+
+	if (touch_device->current_event_ptr == NULL)
+	{
+		/*
+		* let's allocate new event and hold it here.
+		*/
+		touch_device->current_event_ptr = touch_event_create(touch_device);
+
+		/* the input stays put until an event is released */
+		touch_device->out_of_events = (NULL == touch_device->current_event_ptr);
+
+		if (touch_device->out_of_events)
+		{
+			return NULL;
+		}
+	}
+
+	touch_device->current_event_ptr->_parent.type = NYX_EVENT_TOUCHPANEL;
+
+	for (; event_iter < event_count; event_iter++)
+	{
+		input_event_t *input_event_ptr;
+		nyx_touchpanel_event_item_t *item_ptr;
+		input_event_ptr = &touchpanel_event_list.input[event_iter];
+
+		touchpanel_event_list.input_read += sizeof(input_event_t);
+
+		switch (input_event_ptr->type)
+		{
+			case EV_FINGERID:
+				item_ptr = touch_event_get_next_item(
+				               touch_device->current_event_ptr);
+
+				if (NULL == item_ptr)
+				{
+					/* hand out the full event, the finger starts the next one */
+					p_generated = (nyx_event_t *) touch_device->current_event_ptr;
+					touch_device->current_event_ptr = NULL;
+					touchpanel_event_list.input_read -= sizeof(input_event_t);
+				}
+				else
+				{
+					touch_item_reset(item_ptr);
+					item_ptr->finger = input_event_ptr->value * 1000
+					                   + input_event_ptr->code;
+					item_ptr->timestamp = get_ts_tval(&(input_event_ptr->time));
+				}
+
+				break;
+
+			/* starts a frame of its own, see gesture_recognizer_frame() */
+			case EV_GESTURE:
+				item_ptr = touch_event_get_next_item(
+				               touch_device->current_event_ptr);
+
+				if (NULL != item_ptr)
+				{
+					touch_device->current_event_ptr->type =
+					    NYX_TOUCHPANEL_EVENT_TYPE_GESTURE;
+					touch_item_reset(item_ptr);
+					item_ptr->gestureKey = input_event_ptr->code;
+					item_ptr->finger = input_event_ptr->value * 1000;
+					item_ptr->timestamp = get_ts_tval(&(input_event_ptr->time));
+				}
+
+				break;
+
+			case EV_SCALE:
+				item_ptr = touch_event_get_current_item(
+				               touch_device->current_event_ptr);
+
+				if (NULL != item_ptr)
+				{
+					item_ptr->weight = input_event_ptr->value / 1000.0;
+				}
+
+				break;
 
 			case EV_ABS:
 				item_ptr = touch_event_get_current_item(
@@ -748,6 +1905,24 @@ nyx_error_t touchpanel_get_event(nyx_device_t *d, nyx_event_t **e)
 
 				break;
 
+			case EV_VELOCITY:
+				item_ptr = touch_event_get_current_item(
+				               touch_device->current_event_ptr);
+
+				if (NULL != item_ptr)
+				{
+					if (X_DIM == input_event_ptr->code)
+					{
+						item_ptr->xVelocity = input_event_ptr->value;
+					}
+					else
+					{
+						item_ptr->yVelocity = input_event_ptr->value;
+					}
+				}
+
+				break;
+
 			case EV_KEY:
 				item_ptr = touch_event_get_current_item(
 				               touch_device->current_event_ptr);
@@ -773,6 +1948,11 @@ nyx_error_t touchpanel_get_event(nyx_device_t *d, nyx_event_t **e)
 				p_generated = (nyx_event_t *) touch_device->current_event_ptr;
 				touch_device->current_event_ptr = NULL;
 
+				if (NULL != p_generated)
+				{
+					TOUCH_EVENT(p_generated)->kernel_time = input_event_ptr->time;
+				}
+
 				break;
 
 			default:
@@ -787,7 +1967,534 @@ nyx_error_t touchpanel_get_event(nyx_device_t *d, nyx_event_t **e)
 		}
 	}
 
-	*e = p_generated;
+	STAGE_END(touch_device, STAGE_DELIVER, deliver_start);
+
+	return p_generated;
+}
+
+static bool
+frame_has_transition(const nyx_event_touchpanel_t *frame)
+{
+	int i;
+
+	/* gestures are never folded into moves */
+	if (NYX_TOUCHPANEL_EVENT_TYPE_GESTURE == frame->type)
+	{
+		return true;
+	}
+
+	for (i = 0; i < frame->item_count; i++)
+	{
+		if (NYX_TOUCHPANEL_STATE_DOWN == frame->item_array[i].state ||
+		        NYX_TOUCHPANEL_STATE_UP == frame->item_array[i].state)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int
+find_finger(const nyx_event_touchpanel_t *frame, int32_t finger)
+{
+	int i;
+
+	for (i = 0; i < frame->item_count; i++)
+	{
+		if (frame->item_array[i].finger == finger)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Fold a frame of moves into the pending coalesced event, keeping the
+ * previous sample of every finger for resampling. Returns false, leaving the
+ * pending event untouched, when the new fingers do not fit.
+ */
+static bool
+merge_frame(touchpanel_device_t *touch_device, nyx_event_touchpanel_t *pending,
+            const nyx_event_touchpanel_t *frame)
+{
+	int i, added = 0;
+
+	for (i = 0; i < frame->item_count; i++)
+	{
+		if (find_finger(pending, frame->item_array[i].finger) < 0)
+		{
+			added++;
+		}
+	}
+
+	if (pending->item_count + added > NYX_MAX_TOUCH_EVENTS)
+	{
+		return false;
+	}
+
+	for (i = 0; i < frame->item_count; i++)
+	{
+		const nyx_touchpanel_event_item_t *item_ptr = &frame->item_array[i];
+		int index = find_finger(pending, item_ptr->finger);
+
+		if (index < 0)
+		{
+			index = pending->item_count++;
+			touch_device->coalesce_prev[index].valid = false;
+		}
+		else
+		{
+			touch_device->coalesce_prev[index].x = pending->item_array[index].x;
+			touch_device->coalesce_prev[index].y = pending->item_array[index].y;
+			touch_device->coalesce_prev[index].timestamp =
+			    pending->item_array[index].timestamp;
+			touch_device->coalesce_prev[index].valid = true;
+		}
+
+		pending->item_array[index] = *item_ptr;
+	}
+
+	return true;
+}
+
+/*
+ * Furthest a coalesced position is extrapolated past its last sample,
+ * in nanoseconds
+ */
+#define MAX_RESAMPLE_AHEAD_NS   (50 * 1000000LL)
+
+/**
+ * Move every finger of a coalesced event to the target time: between the
+ * last two samples by interpolation, after them along the finger velocity.
+ */
+static void
+resample_frame(touchpanel_device_t *touch_device,
+               nyx_event_touchpanel_t *pending, int64_t target)
+{
+	int i;
+
+	for (i = 0; i < pending->item_count; i++)
+	{
+		nyx_touchpanel_event_item_t *item_ptr = &pending->item_array[i];
+		coalesce_sample_t *prev = &touch_device->coalesce_prev[i];
+		int64_t span = prev->valid ? item_ptr->timestamp - prev->timestamp : 0;
+
+		if (span > 0 && target < item_ptr->timestamp)
+		{
+			int64_t offset = MAX(target - prev->timestamp, 0);
+
+			item_ptr->x = prev->x + (int)((item_ptr->x - prev->x) * offset / span);
+			item_ptr->y = prev->y + (int)((item_ptr->y - prev->y) * offset / span);
+		}
+		else if (target > item_ptr->timestamp)
+		{
+			double ahead = MIN(target - item_ptr->timestamp,
+			                   MAX_RESAMPLE_AHEAD_NS) / 1e9;
+
+			item_ptr->x += (int)(item_ptr->xVelocity * ahead);
+			item_ptr->y += (int)(item_ptr->yVelocity * ahead);
+		}
+		else
+		{
+			continue;
+		}
+
+		item_ptr->timestamp = target;
+	}
+}
+
+/**
+ * Deliver all frames available so far as one event with a single item per
+ * finger. Frames carrying a touch down or release are delivered on their own
+ * so no transition is lost or reordered.
+ */
+static nyx_event_t *
+touchpanel_next_coalesced(touchpanel_device_t *touch_device)
+{
+	nyx_event_touchpanel_t *pending = NULL;
+	nyx_event_touchpanel_t *frame = touch_device->held_event_ptr;
+	int64_t target_time;
+
+	touch_device->held_event_ptr = NULL;
+
+	if (NULL != frame && frame_has_transition(frame))
+	{
+		return (nyx_event_t *) frame;
+	}
+
+	pending = frame;
+
+	if (NULL != pending)
+	{
+		memset(touch_device->coalesce_prev, 0, sizeof(touch_device->coalesce_prev));
+	}
+
+	while (NULL != (frame = (nyx_event_touchpanel_t *) touchpanel_next_frame(
+	                            touch_device)))
+	{
+		if (NULL == pending)
+		{
+			if (frame_has_transition(frame))
+			{
+				return (nyx_event_t *) frame;
+			}
+
+			pending = frame;
+			memset(touch_device->coalesce_prev, 0, sizeof(touch_device->coalesce_prev));
+			continue;
+		}
+
+		if (frame_has_transition(frame) ||
+		        !merge_frame(touch_device, pending, frame))
+		{
+			touch_device->held_event_ptr = frame;
+			break;
+		}
+
+		__atomic_fetch_add(&touch_device->frames_coalesced, 1, __ATOMIC_RELAXED);
+		event_pool_put(&touch_device->event_pool, frame);
+	}
+
+	/* set from the API thread while the reader thread may be here */
+	target_time = __atomic_load_n(&touch_device->target_time, __ATOMIC_RELAXED);
+
+	if (NULL != pending && 0 != target_time)
+	{
+		resample_frame(touch_device, pending, target_time);
+	}
+
+	return (nyx_event_t *) pending;
+}
+
+/**
+ * Deliver the next gesture, handing the touch frames in between back to the
+ * pool.
+ */
+static nyx_event_t *
+touchpanel_next_gesture(touchpanel_device_t *touch_device)
+{
+	nyx_event_touchpanel_t *frame;
+
+	while (NULL != (frame = (nyx_event_touchpanel_t *) touchpanel_next_frame(
+	                            touch_device)))
+	{
+		if (NYX_TOUCHPANEL_EVENT_TYPE_GESTURE == frame->type)
+		{
+			return (nyx_event_t *) frame;
+		}
+
+		event_pool_put(&touch_device->event_pool, frame);
+	}
+
+	return NULL;
+}
+
+static nyx_event_t *
+touchpanel_next_event(touchpanel_device_t *touch_device)
+{
+	int32_t mode = __atomic_load_n(&touch_device->mode, __ATOMIC_ACQUIRE);
+
+	if (TOUCHPANEL_MODE_COALESCE == mode)
+	{
+		return touchpanel_next_coalesced(touch_device);
+	}
+
+	if (TOUCHPANEL_MODE_GESTURES == mode)
+	{
+		return touchpanel_next_gesture(touch_device);
+	}
+
+	return touchpanel_next_frame(touch_device);
+}
+
+/**
+ * Copy a finished event into the next frame of the shared ring and return it
+ * to the pool.
+ */
+static void
+touchpanel_publish_shared(touchpanel_device_t *touch_device,
+                          nyx_event_touchpanel_t *event_ptr)
+{
+	touch_shm_frame_t *p_frame = touch_shm_begin_frame(&touch_device->shm);
+	int count = MIN(event_ptr->item_count, TOUCH_SHM_MAX_ITEMS);
+	int i;
+
+	p_frame->type = event_ptr->type;
+	p_frame->itemCount = count;
+
+	for (i = 0; i < count; i++)
+	{
+		const nyx_touchpanel_event_item_t *p_item = &event_ptr->item_array[i];
+		touch_shm_item_t *p_shared = &p_frame->items[i];
+
+		p_shared->finger = p_item->finger;
+		p_shared->state = p_item->state;
+		p_shared->x = p_item->x;
+		p_shared->y = p_item->y;
+		p_shared->gestureKey = p_item->gestureKey;
+		p_shared->scale = isnan(p_item->weight) ? 0 : lround(p_item->weight * 1000);
+		p_shared->xVelocity = lround(p_item->xVelocity);
+		p_shared->yVelocity = lround(p_item->yVelocity);
+		p_shared->timestamp = p_item->timestamp;
+	}
+
+	touch_shm_end_frame(&touch_device->shm);
+	__atomic_fetch_add(&touch_device->frames_delivered, 1, __ATOMIC_RELAXED);
+	event_pool_put(&touch_device->event_pool, event_ptr);
+}
+
+/**
+ * Write every frame ready on the event node to the shared ring, waking the
+ * client once for the whole batch.
+ */
+static void
+touchpanel_fill_shared(touchpanel_device_t *touch_device)
+{
+	nyx_event_t *p_generated;
+	bool published = false;
+
+	while (NULL != (p_generated = touchpanel_next_frame(touch_device)))
+	{
+		touchpanel_publish_shared(touch_device,
+		                          (nyx_event_touchpanel_t *) p_generated);
+		published = true;
+	}
+
+	if (published)
+	{
+		touch_shm_notify(&touch_device->shm);
+	}
+}
+
+/**
+ * Reader thread: decode the panel input as soon as it arrives and queue the
+ * finished events for touchpanel_get_events().
+ */
+static void *
+touchpanel_reader_thread(void *arg)
+{
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) arg;
+	nyx_event_t *p_generated;
+	int yields = 0;
+
+	do
+	{
+		if (!reader_reserve_events(touch_device))
+		{
+			return NULL;
+		}
+
+		if (TOUCHPANEL_MODE_SHARED_RING ==
+		        __atomic_load_n(&touch_device->mode, __ATOMIC_ACQUIRE))
+		{
+			touchpanel_fill_shared(touch_device);
+			continue;
+		}
+
+		while (NULL != (p_generated = touchpanel_next_event(touch_device)))
+		{
+			if (!input_reader_publish(&touch_device->reader, p_generated))
+			{
+				event_pool_put(&touch_device->event_pool,
+				               (nyx_event_touchpanel_t *) p_generated);
+				return NULL;
+			}
+
+			if (!reader_reserve_events(touch_device))
+			{
+				return NULL;
+			}
+		}
+	}
+	while (touch_device->out_of_events ?
+	        input_reader_backoff(&touch_device->reader, &yields) :
+	        input_reader_wait(&touch_device->reader,
+	                          touch_device->input_eof ? -1 : touchpanel_event_fd));
+
+	return NULL;
+}
+
+/**
+ * Deliver every touch event ready from one read of the event node, up to max
+ * of them, storing their number in n. Once all have been delivered, the next
+ * call reads the event node again.
+ */
+nyx_error_t touchpanel_get_events(nyx_device_t *d, nyx_event_t **events,
+                                  int max, int *n)
+{
+	nyx_event_t *p_generated = NULL;
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == events || NULL == n || max <= 0)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	*n = 0;
+
+	/* frames go to the shared ring, this only pumps the event node */
+	if (TOUCHPANEL_MODE_SHARED_RING ==
+	        __atomic_load_n(&touch_device->mode, __ATOMIC_ACQUIRE))
+	{
+		if (!touch_device->threaded)
+		{
+			touchpanel_fill_shared(touch_device);
+		}
+
+		return NYX_ERROR_NONE;
+	}
+
+	while (*n < max)
+	{
+		if (touch_device->threaded)
+		{
+			p_generated = input_reader_consume(&touch_device->reader);
+		}
+		/* a coalesced event may have drained the read already */
+		else if (*n > 0 && !touch_device->read_input)
+		{
+			break;
+		}
+		else
+		{
+			p_generated = touchpanel_next_event(touch_device);
+		}
+
+		if (NULL == p_generated)
+		{
+			break;
+		}
+
+		/* measured on handing out, after any queueing on the reader thread */
+		latency_histogram_record(&touch_device->latency,
+		                         input_event_latency(sEventClock,
+		                                 &TOUCH_EVENT(p_generated)->kernel_time));
+		__atomic_fetch_add(&touch_device->frames_delivered, 1, __ATOMIC_RELAXED);
+		events[(*n)++] = p_generated;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t touchpanel_get_event(nyx_device_t *d, nyx_event_t **e)
+{
+	int n = 0;
+	nyx_error_t error = touchpanel_get_events(d, e, 1, &n);
+
+	if (NULL != e && 0 == n)
+	{
+		*e = NULL;
+	}
+
+	return error;
+}
+
+/**
+ * Report the number of read() calls issued on the event node and the number
+ * of touch events delivered, so the syscall cost per frame can be checked.
+ */
+nyx_error_t touchpanel_get_read_stats(nyx_device_t *d, unsigned int *syscalls,
+                                      unsigned int *frames)
+{
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == syscalls || NULL == frames)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	*syscalls = __atomic_load_n(&touch_device->read_syscalls, __ATOMIC_RELAXED);
+	*frames = __atomic_load_n(&touch_device->frames_delivered, __ATOMIC_RELAXED);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Report how often the kernel dropped panel input because it was not read
+ * in time. Each drop is followed by a resync of the contact state.
+ */
+nyx_error_t touchpanel_get_dropped_count(nyx_device_t *d, unsigned int *drops)
+{
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == drops)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	*drops = __atomic_load_n(&touch_device->syn_dropped, __ATOMIC_RELAXED);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Copy the histogram of latencies from the kernel time stamp of a frame to
+ * its delivery, see LATENCY_HISTOGRAM_BUCKETS for the bucket bounds. Call it
+ * from the thread that calls touchpanel_get_events().
+ */
+nyx_error_t touchpanel_get_latency_histogram(nyx_device_t *d,
+        unsigned int *buckets, unsigned int num_buckets)
+{
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == buckets)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	latency_histogram_copy(&touch_device->latency, buckets, num_buckets);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Report the time spent in each pipeline stage, indexed by
+ * pipeline_stage_t. All zero unless built with TOUCHPANEL_STAGE_TIMING.
+ */
+nyx_error_t touchpanel_get_stage_times(nyx_device_t *d, uint64_t *stage_ns,
+                                       unsigned int num_stages)
+{
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+	unsigned int i;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == stage_ns)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	for (i = 0; i < num_stages; i++)
+	{
+		stage_ns[i] = (i < NUM_STAGES) ?
+		              __atomic_load_n(&touch_device->stage_ns[i], __ATOMIC_RELAXED) : 0;
+	}
 
 	return NYX_ERROR_NONE;
 }
@@ -814,10 +2521,126 @@ nyx_error_t touchpanel_get_idle_scan_rate(nyx_device_t *d, unsigned int *r)
 
 nyx_error_t touchpanel_set_mode(nyx_device_t *d, int m)
 {
-	return NYX_ERROR_NOT_IMPLEMENTED;
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (TOUCHPANEL_MODE_FRAMES != m && TOUCHPANEL_MODE_COALESCE != m &&
+	        TOUCHPANEL_MODE_SHARED_RING != m && TOUCHPANEL_MODE_GESTURES != m)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	/* the ring outlives a switch back to event delivery, so a client that
+	 * mapped it never sees it go away before close */
+	if (TOUCHPANEL_MODE_SHARED_RING == m && NULL == touch_device->shm.pRing)
+	{
+		if (touch_shm_create(&touch_device->shm) < 0)
+		{
+			return NYX_ERROR_GENERIC;
+		}
+	}
+
+	__atomic_store_n(&touch_device->mode, m, __ATOMIC_RELEASE);
+
+	return NYX_ERROR_NONE;
 }
 
 nyx_error_t touchpanel_get_mode(nyx_device_t *d, int *m)
 {
-	return NYX_ERROR_NOT_IMPLEMENTED;
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == m)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	*m = __atomic_load_n(&touch_device->mode, __ATOMIC_ACQUIRE);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Set the time, in nanoseconds on the event clock, coalesced events are
+ * resampled to, typically the next vsync. 0 reports the last sample.
+ */
+nyx_error_t touchpanel_set_target_time(nyx_device_t *d, int64_t timestamp)
+{
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	__atomic_store_n(&touch_device->target_time, timestamp, __ATOMIC_RELAXED);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Hand out the memfd of the shared frame ring, TOUCH_SHM_SIZE bytes laid out
+ * as touch_shm_ring_t, and the eventfd signalled when frames are published.
+ * Only valid once TOUCHPANEL_MODE_SHARED_RING has been set; the descriptors
+ * stay owned by the module.
+ */
+nyx_error_t touchpanel_get_shared_ring(nyx_device_t *d, int *mem_fd,
+                                       int *wake_fd)
+{
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == mem_fd || NULL == wake_fd)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	if (NULL == touch_device->shm.pRing)
+	{
+		return NYX_ERROR_INVALID_OPERATION;
+	}
+
+	*mem_fd = touch_device->shm.memFd;
+	*wake_fd = touch_device->shm.wakeFd;
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+ * Report how many touch events the event pool owns and the maximum number
+ * that have been in use at the same time.
+ */
+nyx_error_t touchpanel_get_event_pool_stats(nyx_device_t *d,
+        unsigned int *allocated, unsigned int *high_water)
+{
+	touchpanel_device_t *touch_device = (touchpanel_device_t *) d;
+
+	if (NULL == d)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (NULL == allocated || NULL == high_water)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	*allocated = __atomic_load_n(&touch_device->event_pool.allocated,
+	                             __ATOMIC_RELAXED);
+	*high_water = __atomic_load_n(&touch_device->event_pool.high_water,
+	                              __ATOMIC_RELAXED);
+
+	return NYX_ERROR_NONE;
 }
@@ -0,0 +1,160 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nyx/module/nyx_log.h>
+
+#include "touchpanel_gestures.h"
+#include "touchpanel_capture.h"
+
+/**
+ *******************************************************************************
+ * @brief Create a capture file and write its header
+ *
+ * The capture holds raw touch input, so only its owner may read it. A named
+ * pipe needs its reader opened first, opening it fails otherwise.
+ *
+ * @param  pPath    IN      file to create, truncated if it exists
+ * @param  pHeader  IN/OUT  geometry of the recorded panel, magic, version and
+ *                          event size are filled in
+ *
+ * @retval descriptor to append raw events to, or -1 on error
+ *******************************************************************************
+ */
+int
+capture_open_record(const char *pPath, capture_header_t *pHeader)
+{
+	/* not blocking on a named pipe without a reader, writes do block */
+	int fd = open(pPath, O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK | O_CLOEXEC,
+	              0600);
+
+	if (fd < 0 || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK) < 0)
+	{
+		nyx_error("Failed to create capture file %s", pPath);
+
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+
+		return -1;
+	}
+
+	memcpy(pHeader->magic, CAPTURE_MAGIC, sizeof(pHeader->magic));
+	pHeader->version = CAPTURE_VERSION;
+	pHeader->eventSize = sizeof(input_event_t);
+
+	if (write(fd, pHeader, sizeof(*pHeader)) != sizeof(*pHeader))
+	{
+		nyx_error("Failed to write capture header to %s", pPath);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Read the whole header, however a pipe splits it up */
+static int
+read_header(int fd, capture_header_t *pHeader)
+{
+	char *pDest = (char *) pHeader;
+	size_t done = 0;
+	ssize_t rd;
+
+	while (done < sizeof(*pHeader))
+	{
+		rd = read(fd, pDest + done, sizeof(*pHeader) - done);
+
+		if (rd < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (rd <= 0)
+		{
+			return -1;
+		}
+
+		done += rd;
+	}
+
+	return 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Open a capture file or pipe for replay and read its header
+ *
+ * A named pipe needs its writer opened first, without one there is no
+ * header to read and opening fails rather than waiting for it.
+ *
+ * @param  pPath    IN      capture file or named pipe
+ * @param  pHeader  OUT     geometry of the recorded panel
+ *
+ * @retval non-blocking descriptor positioned at the first raw event, or -1
+ *******************************************************************************
+ */
+int
+capture_open_replay(const char *pPath, capture_header_t *pHeader)
+{
+	/* opening a named pipe without a writer would block */
+	int fd = open(pPath, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		nyx_error("Failed to open capture %s", pPath);
+		return -1;
+	}
+
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK) < 0)
+	{
+		goto error;
+	}
+
+	/* a pipe may deliver the header in pieces, so read it blocking */
+	if (read_header(fd, pHeader) < 0 ||
+	        memcmp(pHeader->magic, CAPTURE_MAGIC, sizeof(pHeader->magic)) != 0 ||
+	        pHeader->version != CAPTURE_VERSION)
+	{
+		nyx_error("%s is not a touchpanel capture", pPath);
+		goto error;
+	}
+
+	if (pHeader->eventSize != sizeof(input_event_t))
+	{
+		nyx_error("%s was recorded with %u byte events, expected %zu", pPath,
+		          pHeader->eventSize, sizeof(input_event_t));
+		goto error;
+	}
+
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+	{
+		goto error;
+	}
+
+	return fd;
+
+error:
+	close(fd);
+	return -1;
+}
@@ -0,0 +1,48 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#ifndef __TOUCHPANEL_CAPTURE_H
+#define __TOUCHPANEL_CAPTURE_H
+
+#include <stdint.h>
+
+#define CAPTURE_MAGIC       "NYXTPCAP"
+#define CAPTURE_VERSION     1
+
+/**
+ * A capture file is this header followed by the raw input events exactly
+ * as read from the event node. The header carries what the module would
+ * otherwise query from the panel and the framebuffer, so a capture replays
+ * the same way on a machine without either.
+ */
+typedef struct capture_header
+{
+	char magic[8];          /**< CAPTURE_MAGIC, not terminated */
+	uint32_t version;
+	uint32_t eventSize;     /**< sizeof(input_event_t) of the recorder */
+	int32_t panelMaxX;
+	int32_t panelMaxY;
+	int32_t displayX;
+	int32_t displayY;
+	int32_t mtSlots;        /**< protocol B slots, 0 for single touch panels */
+} capture_header_t;
+
+int capture_open_record(const char *pPath, capture_header_t *pHeader);
+int capture_open_replay(const char *pPath, capture_header_t *pHeader);
+
+#endif  /* __TOUCHPANEL_CAPTURE_H */
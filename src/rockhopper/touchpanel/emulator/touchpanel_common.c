@@ -31,10 +31,8 @@ set_event_params(input_event_t *pEvent, time_stamp_t *pTime, uint16_t type,
 		return;
 	}
 
-	((struct timeval *)pTime)->tv_sec = ((time_stamp_t *)
-	                                     &pEvent->time)->time.tv_sec;
-	((struct timeval *)pTime)->tv_usec = ((time_stamp_t *)
-	                                      &pEvent->time)->time.tv_nsec / 1000;
+	pEvent->time.tv_sec = pTime->time.tv_sec;
+	pEvent->time.tv_usec = pTime->time.tv_nsec / 1000;
 
 	pEvent->type = type;
 	pEvent->code = code;
@@ -18,7 +18,10 @@
 
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <limits.h>
+#include <math.h>
 #include <glib-2.0/glib.h>
 
 #include <nyx/module/nyx_log.h>
@@ -26,21 +29,59 @@
 #include "touchpanel_gestures.h"
 #include "touchpanel_common.h"
 
-static GList *sFingers = NULL;
-static GQueue availableFingers = G_QUEUE_INIT;
+static finger_tracker_t sTracker;
 
 static uint32_t curFingerId = 0;
 
-int gesture_state_machine_finger(finger_t *finger, input_event_t *events,
-                                 int *numEvents);
+static int gesture_state_machine_finger(int slot, input_event_t *events,
+                                        int *numEvents, const time_stamp_t *pCurTime);
 
 static const general_settings_t *spGeneralSettings = NULL;
 
+typedef struct pending_gesture
+{
+	gesture_key_t key;
+	uint32_t id;
+	int x;
+	int y;
+	int xVelocity;
+	int yVelocity;
+	int scale;                  /**< pinch only, in 1/1000 */
+	time_stamp_t time;
+} pending_gesture_t;
+
+/**
+ * Recognizer state shared by all fingers: the last tap for double taps, the
+ * position of every finger down for pinches and the gestures found in the
+ * frame being generated.
+ */
+typedef struct gesture_recognizer
+{
+	int numPending;
+	pending_gesture_t pending[MAX_GESTURES_PER_FRAME];
+
+	bool lastTapValid;
+	int lastTap[NUM_DIMENSIONS];
+	time_stamp_t lastTapTime;
+
+	int numFingers;
+	uint32_t fingerId[MAX_TRACKED_FINGERS];
+	int fingerX[MAX_TRACKED_FINGERS];
+	int fingerY[MAX_TRACKED_FINGERS];
+
+	uint32_t pinchId[2];        /**< fingers of the pinch being tracked */
+	int pinchSpan;              /**< span at the last pinch step, 0 if none */
+	bool pinched;               /**< a step was reported for the pinch fingers */
+} gesture_recognizer_t;
+
+static gesture_recognizer_t sRecognizer;
+
 /**
  *******************************************************************************
- * @brief Allocate and initialize the buffer that keeps a coordinate history
+ * @brief Initialize the buffer that keeps a coordinate history
  *
- * @param  ppCoordBuf   IN/OUT  ptr to the coordinate buffer struct
+ * @param  pCoordBuf    IN/OUT  ptr to the coordinate buffer struct
+ * @param  pCoords      IN      storage for bufSize coordinates
  * @param  bufSize      IN      size of the buffer
  *
  * @retval  0 on success
@@ -48,55 +89,131 @@ static const general_settings_t *spGeneralSettings = NULL;
  *******************************************************************************
  */
 int
-create_coord_buffer(coord_buf_t *pCoordBuf, int bufSize)
+init_coord_buffer(coord_buf_t *pCoordBuf, coord_t *pCoords, int bufSize)
 {
 
-	if (NULL == pCoordBuf)
+	if (NULL == pCoordBuf || NULL == pCoords)
 	{
 		nyx_error("NULL parameter passed");
 		return -1;
 	}
 
-	pCoordBuf->pCoords = (coord_t *)malloc(sizeof(coord_t) * bufSize);
+	pCoordBuf->pCoords = pCoords;
+	pCoordBuf->size = bufSize;
+	reset_coord_buffer(pCoordBuf);
 
-	if (NULL == pCoordBuf->pCoords)
-	{
-		nyx_error("Failed to allocate memory");
-		return -1;
-	}
+	return 0;
+}
 
-	pCoordBuf->size = bufSize;
+
+void
+reset_coord_buffer(coord_buf_t *pCoordBuf)
+{
 	pCoordBuf->head = 0;
 	pCoordBuf->tail = 0;
 	pCoordBuf->numItems = 0;
+	pCoordBuf->refTime = 0;
+	pCoordBuf->sumT = 0;
+	pCoordBuf->sumTT = 0;
+	pCoordBuf->sumX = 0;
+	pCoordBuf->sumY = 0;
+	pCoordBuf->sumTX = 0;
+	pCoordBuf->sumTY = 0;
+}
 
-	return 0;
+static inline int64_t
+time_stamp_usec(const time_stamp_t *pTime)
+{
+	return pTime->time.tv_sec * 1000000LL + pTime->time.tv_nsec / 1000;
 }
 
+static void
+add_coord_sums(coord_buf_t *pCoordBuf, const coord_t *pCoord, int sign)
+{
+	int64_t t = time_stamp_usec(&pCoord->timeStamp) - pCoordBuf->refTime;
+
+	pCoordBuf->sumT += sign * t;
+	pCoordBuf->sumTT += sign * t * t;
+	pCoordBuf->sumX += sign * pCoord->x;
+	pCoordBuf->sumY += sign * pCoord->y;
+	pCoordBuf->sumTX += sign * t * pCoord->x;
+	pCoordBuf->sumTY += sign * t * pCoord->y;
+}
 
-void
-free_coord_buffer(coord_buf_t *pCoordBuf)
+static double
+smoothing_factor(double cutoff, double dt)
 {
-	free(pCoordBuf->pCoords);
+	double tau = 1.0 / (2.0 * M_PI * cutoff);
+
+	return 1.0 / (1.0 + tau / dt);
 }
 
+/**
+ *******************************************************************************
+ * @brief 1 euro filter step: a low pass whose cutoff rises with the speed, so
+ *        a resting finger is steady while a fast drag keeps little lag
+ *
+ * @param  pState   IN/OUT  filter state of one dimension
+ * @param  value    IN      sampled position
+ * @param  dt       IN      seconds since the previous sample
+ *
+ * @retval filtered position
+ *******************************************************************************
+ */
+static int
+one_euro_filter(one_euro_state_t *pState, int value, double dt)
+{
+	double speed = (value - pState->value) / dt;
+	double cutoff;
+
+	pState->deriv += smoothing_factor(spGeneralSettings->filterDCutoff, dt) *
+	                 (speed - pState->deriv);
 
-void
-reset_coord_buffer(coord_buf_t *pCoordBuf)
+	cutoff = spGeneralSettings->filterMinCutoff +
+	         spGeneralSettings->filterBeta * fabs(pState->deriv);
+	pState->value += smoothing_factor(cutoff, dt) * (value - pState->value);
+
+	return (int) floor(pState->value + 0.5);
+}
+
+/* Move the time origin of the running sums by delta usec */
+static void
+rebase_coord_sums(coord_buf_t *pCoordBuf, int64_t delta)
 {
-	pCoordBuf->head = 0;
-	pCoordBuf->tail = 0;
-	pCoordBuf->numItems = 0;
+	int64_t n = pCoordBuf->numItems;
+
+	pCoordBuf->sumTT += delta * (n * delta - 2 * pCoordBuf->sumT);
+	pCoordBuf->sumT -= n * delta;
+	pCoordBuf->sumTX -= delta * pCoordBuf->sumX;
+	pCoordBuf->sumTY -= delta * pCoordBuf->sumY;
+	pCoordBuf->refTime += delta;
 }
 
 void
 update_coord_buffer(coord_buf_t *pCoordBuf, int xCoord, int yCoord,
                     const time_stamp_t *pTime)
 {
+	bool first = (pCoordBuf->numItems == 0);
+	int64_t lastTime = 0;
+
+	if (first)
+	{
+		pCoordBuf->refTime = time_stamp_usec(pTime);
+	}
+	else
+	{
+		time_stamp_t prevTime;
+
+		get_last_coords(pCoordBuf, NULL, NULL, &prevTime);
+		lastTime = time_stamp_usec(&prevTime);
+	}
+
 	if (pCoordBuf->head == pCoordBuf->tail &&
 	        pCoordBuf->numItems == pCoordBuf->size)
 	{
 		/* full buffer, so make space for new item and overwrite old one */
+		add_coord_sums(pCoordBuf, &pCoordBuf->pCoords[pCoordBuf->head], -1);
+		pCoordBuf->numItems--;
 		pCoordBuf->head = (pCoordBuf->head + 1) % pCoordBuf->size;
 	}
 
@@ -138,16 +255,70 @@ update_coord_buffer(coord_buf_t *pCoordBuf, int xCoord, int yCoord,
 		}
 	}
 
+	if (FILTER_ONE_EURO == spGeneralSettings->filterMode)
+	{
+		if (first)
+		{
+			pCoordBuf->filter[X_DIM].value = xCoord;
+			pCoordBuf->filter[X_DIM].deriv = 0;
+			pCoordBuf->filter[Y_DIM].value = yCoord;
+			pCoordBuf->filter[Y_DIM].deriv = 0;
+		}
+		else
+		{
+			/* samples sharing a time stamp are treated as 1 ms apart */
+			double dt = MAX(time_stamp_usec(pTime) - lastTime, 1000) / 1e6;
+
+			xCoord = one_euro_filter(&pCoordBuf->filter[X_DIM], xCoord, dt);
+			yCoord = one_euro_filter(&pCoordBuf->filter[Y_DIM], yCoord, dt);
+		}
+	}
+
 	pCurCoord->timeStamp = *pTime;
 	pCurCoord->x = xCoord;
 	pCurCoord->y = yCoord;
 
+	add_coord_sums(pCoordBuf, pCurCoord, 1);
+
 	if (pCoordBuf->numItems < pCoordBuf->size)
 	{
 		pCoordBuf->numItems++;
 	}
 
 	pCoordBuf->tail = (pCoordBuf->tail + 1) % pCoordBuf->size;
+
+	/* keep the time origin at the oldest item so the sums stay small */
+	rebase_coord_sums(pCoordBuf,
+	                  time_stamp_usec(&pCoordBuf->pCoords[pCoordBuf->head].timeStamp) -
+	                  pCoordBuf->refTime);
+}
+
+/**
+ *******************************************************************************
+ * @brief Least-squares velocity over the coordinate history, in O(1)
+ *
+ * @param  pCoordBuf    IN      coordinate buffer
+ * @param  pXVelocity   OUT     horizontal velocity in pixels per second
+ * @param  pYVelocity   OUT     vertical velocity in pixels per second
+ *******************************************************************************
+ */
+void
+get_velocity(const coord_buf_t *pCoordBuf, int *pXVelocity, int *pYVelocity)
+{
+	int64_t n = pCoordBuf->numItems;
+	int64_t den = n * pCoordBuf->sumTT - pCoordBuf->sumT * pCoordBuf->sumT;
+
+	if (n < 2 || den <= 0)
+	{
+		*pXVelocity = 0;
+		*pYVelocity = 0;
+		return;
+	}
+
+	*pXVelocity = (int)((n * pCoordBuf->sumTX - pCoordBuf->sumT *
+	                     pCoordBuf->sumX) * 1000000LL / den);
+	*pYVelocity = (int)((n * pCoordBuf->sumTY - pCoordBuf->sumT *
+	                     pCoordBuf->sumY) * 1000000LL / den);
 }
 
 void get_last_coords(const coord_buf_t *pCoordBuf, int *xCoord, int *yCoord,
@@ -172,53 +343,70 @@ void get_last_coords(const coord_buf_t *pCoordBuf, int *xCoord, int *yCoord,
 	}
 }
 
-void init_gesture_state_machine(const general_settings_t *pGeneralSettings,
-                                int maxFingers)
+/**
+ *******************************************************************************
+ * @brief Extrapolate the last position along the least-squares velocity
+ *
+ * @param  pCoordBuf    IN      coordinate buffer
+ * @param  aheadMs      IN      look-ahead, 0 returns the last position
+ * @param  xCoord       OUT     predicted x
+ * @param  yCoord       OUT     predicted y
+ *******************************************************************************
+ */
+void
+get_predicted_coords(const coord_buf_t *pCoordBuf, int aheadMs, int *xCoord,
+                     int *yCoord)
 {
-	int i;
+	int xVelocity, yVelocity;
 
-	spGeneralSettings = pGeneralSettings;
+	get_last_coords(pCoordBuf, xCoord, yCoord, NULL);
 
-	for (i = 0 ; i < maxFingers * 2; i++)
+	if (aheadMs <= 0)
 	{
-		finger_t *finger = malloc(sizeof(finger_t));
-		create_coord_buffer(&finger->coords, pGeneralSettings->coordBufSize);
-		finger->state.state = UNUSED;
-		g_queue_push_tail(&availableFingers, finger);
+		return;
 	}
-}
 
+	get_velocity(pCoordBuf, &xVelocity, &yVelocity);
+	*xCoord += (int)((int64_t) xVelocity * aheadMs / 1000);
+	*yCoord += (int)((int64_t) yVelocity * aheadMs / 1000);
+}
 
-void
-deinit_gesture_state_machine(void)
+void init_gesture_state_machine(const general_settings_t *pGeneralSettings,
+                                int maxFingers)
 {
-	finger_t *finger = NULL;
+	int i;
+
+	spGeneralSettings = pGeneralSettings;
 
-	while ((finger = g_queue_pop_head(&availableFingers)) != NULL)
+	memset(&sRecognizer, 0, sizeof(sRecognizer));
+	memset(&sTracker, 0, sizeof(sTracker));
+	sTracker.numSlots = MIN(maxFingers * 2, MAX_TRACKED_FINGERS);
+	sTracker.pCoordArena = (coord_t *)calloc(MAX_TRACKED_FINGERS *
+	                       pGeneralSettings->coordBufSize, sizeof(coord_t));
+
+	if (NULL == sTracker.pCoordArena)
 	{
-		free_coord_buffer(&finger->coords);
-		free(finger);
+		nyx_error("Failed to allocate memory");
+		sTracker.numSlots = 0;
+		return;
 	}
 
-	finger = NULL;
-	GList *l = sFingers;
-
-	while (l != NULL)
+	for (i = 0; i < MAX_TRACKED_FINGERS; i++)
 	{
-		if (l->data)
-		{
-			finger = (finger_t *)l->data;
-			free_coord_buffer(&finger->coords);
-		}
+		init_coord_buffer(&sTracker.coords[i],
+		                  &sTracker.pCoordArena[i * pGeneralSettings->coordBufSize],
+		                  pGeneralSettings->coordBufSize);
+		sTracker.state[i].state = UNUSED;
+	}
+}
 
-		l = g_list_remove(l, l->data);
 
-		if (finger)
-		{
-			free(finger);
-			finger = NULL;
-		}
-	}
+void
+deinit_gesture_state_machine(void)
+{
+	free(sTracker.pCoordArena);
+	memset(&sTracker, 0, sizeof(sTracker));
+	memset(&sRecognizer, 0, sizeof(sRecognizer));
 }
 
 void
@@ -231,146 +419,236 @@ reset_state_data(gesture_state_data_t *pStateData)
 static void add_new_finger(int x, int y, int weight,
                            const time_stamp_t *pCurTime)
 {
-	finger_t *finger = g_queue_pop_head(&availableFingers);
+	int slot;
+
+	for (slot = 0; slot < sTracker.numSlots; slot++)
+	{
+		if (sTracker.state[slot].state == UNUSED)
+		{
+			break;
+		}
+	}
 
-	if (!finger)
+	if (slot == sTracker.numSlots)
 	{
 		nyx_info("No available finger buffers, rejecting finger\n");
 		return;
 	}
 
-	//  ASSERT(finger->state.state == UNUSED);
-	reset_state_data(&finger->state);
-	finger->id = curFingerId++;
-	finger->timestamp = *pCurTime;
-	//hal_info"NEW: %ld,%ld\n",finger->id.time.tv_sec,finger->id.time.tv_nsec);
-	finger->minDist = 0;
-	finger->minDistId = 0;
-	finger->lastWeight = weight;
-	reset_coord_buffer(&finger->coords);
-	update_coord_buffer(&finger->coords, x, y, pCurTime);
+	reset_state_data(&sTracker.state[slot]);
+	sTracker.id[slot] = curFingerId++;
+	sTracker.lastWeight[slot] = weight;
+	sTracker.match[slot] = 0;
+	reset_coord_buffer(&sTracker.coords[slot]);
+	update_coord_buffer(&sTracker.coords[slot], x, y, pCurTime);
+	get_last_coords(&sTracker.coords[slot], &sTracker.lastX[slot],
+	                &sTracker.lastY[slot], NULL);
 	nyx_info("Finger down at %d,%d\n", x, y);
-	sFingers = g_list_prepend(sFingers, finger);
+	sTracker.active[sTracker.numActive++] = slot;
 }
 
-
-#define MAX_EVENTS_PER_UPDATE 100
-
-/*
- * Finger tracking:
- * The hardware does not do any fingertracking, so we do it all here.
+/**
+ * Solve the assignment problem for a k x k cost matrix with the Hungarian
+ * method in O(k^3). On return pAssignment[row] is the column given to row.
  */
-void
-gesture_state_machine(int *pXCoords, int *pYCoords, const int *pFingerWeights,
-                      int numFingers, const time_stamp_t *pCurTime,
-                      input_event_t *events, int *numEvents)
+static void
+solve_assignment(int64_t cost[MAX_TRACKED_FINGERS][MAX_TRACKED_FINGERS],
+                 int k, int *pAssignment)
 {
-	/* Update Fingers */
-	int j;
-	int timestmpcnt = 0;
-	GList *list;
-
-	//For each new finger
-	for (j = 0; j < numFingers; j++)
+	int64_t u[MAX_TRACKED_FINGERS + 1] = { 0 };
+	int64_t v[MAX_TRACKED_FINGERS + 1] = { 0 };
+	int64_t minv[MAX_TRACKED_FINGERS + 1];
+	int p[MAX_TRACKED_FINGERS + 1] = { 0 };
+	int way[MAX_TRACKED_FINGERS + 1] = { 0 };
+	bool used[MAX_TRACKED_FINGERS + 1];
+	int i, j;
+
+	/* rows and columns are 1-based here, 0 is the virtual start column */
+	for (i = 1; i <= k; i++)
 	{
-		int minDist = INT_MAX;
-		GList *minId = NULL;
-		list = g_list_first(sFingers);
+		int j0 = 0;
+		p[0] = i;
 
-		//Try and match it against one of the existing ones
-		while (list)
+		for (j = 0; j <= k; j++)
 		{
-			int xPrev, yPrev;
-			int matched = 0;
-			finger_t *finger = (finger_t *)list->data;
+			minv[j] = INT64_MAX;
+			used[j] = false;
+		}
 
-			get_last_coords(&finger->coords, &xPrev, &yPrev, NULL);
-			int dx = pXCoords[j] - xPrev;
-			int dy = pYCoords[j] - yPrev;
-			int dist = (dx * dx + dy * dy);
+		do
+		{
+			int i0 = p[j0];
+			int j1 = 0;
+			int64_t delta = INT64_MAX;
 
-			//Another finger from the input list is already a better match.
-			if (dist > finger->minDist)
-			{
-				list = g_list_next(list);
-				continue;
-			}
+			used[j0] = true;
 
-			if (dist < minDist)
+			for (j = 1; j <= k; j++)
 			{
-				matched = 1;
+				if (!used[j])
+				{
+					int64_t cur = cost[i0 - 1][j - 1] - u[i0] - v[j];
+
+					if (cur < minv[j])
+					{
+						minv[j] = cur;
+						way[j] = j0;
+					}
+
+					if (minv[j] < delta)
+					{
+						delta = minv[j];
+						j1 = j;
+					}
+				}
 			}
 
-			if (matched)
+			for (j = 0; j <= k; j++)
 			{
-				minId = list;
-				minDist = dist;
+				if (used[j])
+				{
+					u[p[j]] += delta;
+					v[j] -= delta;
+				}
+				else
+				{
+					minv[j] -= delta;
+				}
 			}
 
-			list = g_list_next(list);
+			j0 = j1;
 		}
+		while (p[j0] != 0);
+
+		do
+		{
+			int j1 = way[j0];
+			p[j0] = p[j1];
+			j0 = j1;
+		}
+		while (j0);
+	}
 
-		if (minId)
+	for (j = 1; j <= k; j++)
+	{
+		pAssignment[p[j] - 1] = j - 1;
+	}
+}
+
+/**
+ * Match the tracked fingers against the new coordinates, minimizing the sum
+ * of squared distances. sTracker.match[] is set to the input index of every
+ * tracked finger, or -1 if it has no counterpart anymore.
+ */
+static void
+match_fingers(const int *pXCoords, const int *pYCoords, int numFingers)
+{
+	int64_t cost[MAX_TRACKED_FINGERS][MAX_TRACKED_FINGERS];
+	int assignment[MAX_TRACKED_FINGERS];
+	int n = sTracker.numActive;
+	int k = MAX(n, numFingers);
+	int i, j;
+
+	if (n == 0)
+	{
+		return;
+	}
+
+	/* pad to a square matrix, dummy rows/columns cost nothing */
+	for (i = 0; i < k; i++)
+	{
+		int slot = (i < n) ? sTracker.active[i] : -1;
+
+		for (j = 0; j < k; j++)
 		{
-			finger_t *finger = (finger_t *)minId->data;
-			finger->minDistId = j;
-			finger->minDist = minDist;
+			if (slot < 0 || j >= numFingers)
+			{
+				cost[i][j] = 0;
+			}
+			else
+			{
+				int64_t dx = pXCoords[j] - sTracker.lastX[slot];
+				int64_t dy = pYCoords[j] - sTracker.lastY[slot];
+				cost[i][j] = dx * dx + dy * dy;
+			}
 		}
 	}
 
-	//Okay, at this point, for each existing finger, (sFingers)
-	//We have set minDistId to the index of the finger in the input array
-	//Or it's set to INT_MAX if it didn't match any of the new fingers.
+	solve_assignment(cost, k, assignment);
+
+	for (i = 0; i < n; i++)
+	{
+		sTracker.match[sTracker.active[i]] = (assignment[i] < numFingers) ?
+		                                     assignment[i] : -1;
+	}
+}
+
 
-	//Iterate through the fingerList, and update each of the fingers that has a match with new coordinates.
-	list = g_list_first(sFingers);
+#define MAX_EVENTS_PER_UPDATE 100
 
-	while (list)
+/*
+ * Finger tracking:
+ * The hardware does not do any fingertracking, so we do it all here.
+ */
+void
+gesture_state_machine(int *pXCoords, int *pYCoords, const int *pFingerWeights,
+                      int numFingers, const time_stamp_t *pCurTime,
+                      input_event_t *events, int *numEvents)
+{
+	bool consumed[MAX_TRACKED_FINGERS] = { false };
+	int firstEvent = *numEvents;
+	int i, j;
+	int timestmpcnt = 0;
+
+	if (numFingers > MAX_TRACKED_FINGERS)
+	{
+		nyx_info("Ignoring %d fingers beyond tracker capacity\n",
+		         numFingers - MAX_TRACKED_FINGERS);
+		numFingers = MAX_TRACKED_FINGERS;
+	}
+
+	match_fingers(pXCoords, pYCoords, numFingers);
+
+	//Update each of the fingers that has a match with new coordinates.
+	for (i = 0; i < sTracker.numActive; i++)
 	{
-		finger_t *finger = (finger_t *)list->data;
+		int slot = sTracker.active[i];
+		int m = sTracker.match[slot];
 
 		//Finger released
-		if (finger->minDist == INT_MAX)
+		if (m < 0)
 		{
-			list = g_list_next(list);
 			continue;
 		}
 
-		nyx_info("New coord (at: %d), %d,%d weight: %d, distance: %d\n",
-		         finger->minDistId, pXCoords[finger->minDistId], pYCoords[finger->minDistId],
-		         pFingerWeights[finger->minDistId], finger->minDist);
+		nyx_info("New coord (at: %d), %d,%d weight: %d\n",
+		         m, pXCoords[m], pYCoords[m], pFingerWeights[m]);
 
 		//Let's ignore the coordinate if there was a huge difference in weight
 		//This is a common scenario when the user is releasing his finger.
-		if (finger->lastWeight / 2 < pFingerWeights[finger->minDistId])
+		if (sTracker.lastWeight[slot] / 2 < pFingerWeights[m])
 		{
-			update_coord_buffer(&finger->coords, pXCoords[finger->minDistId],
-			                    pYCoords[finger->minDistId], pCurTime);
+			update_coord_buffer(&sTracker.coords[slot], pXCoords[m], pYCoords[m],
+			                    pCurTime);
+			get_last_coords(&sTracker.coords[slot], &sTracker.lastX[slot],
+			                &sTracker.lastY[slot], NULL);
 		}
 		else
 		{
 			nyx_info("Ignoring coordinate\n");
 		}
 
-		finger->lastWeight = pFingerWeights[finger->minDistId];
+		sTracker.lastWeight[slot] = pFingerWeights[m];
 		//remove finger from pool of "new" fingers.
-		pXCoords[finger->minDistId] = pYCoords[finger->minDistId] = 0;
-
-		finger->minDist = 0;
-		finger->minDistId = 0;
-		list = g_list_next(list);
+		consumed[m] = true;
 	}
 
-	//Now go through the list and find any new unmatched fingers
+	//Now go through the input and find any new unmatched fingers
 	for (j = 0; j < numFingers; j++)
 	{
 		time_stamp_t ts = *pCurTime;
 
-		/* When dragging over the gesture button, we get spurious
-		 * "extra" fingers Disregard these events if we already
-		 * matched a finger in the gesture area
-		 */
-		if (pXCoords[j] == 0 && pYCoords[j] == 0)
+		if (consumed[j])
 		{
 			continue;
 		}
@@ -393,58 +671,59 @@ gesture_state_machine(int *pXCoords, int *pYCoords, const int *pFingerWeights,
 	}
 
 	/* All fingers has been matched, now let's process the changes */
-	list = g_list_first(sFingers);
-
-	while (list)
+	for (i = 0; i < sTracker.numActive;)
 	{
-		finger_t *finger = (finger_t *)list->data;
+		int slot = sTracker.active[i];
 
-		//-1 means to move the list element into the available list
-		if (gesture_state_machine_finger(finger, events, numEvents) == -1)
+		//-1 means to give the slot back
+		if (gesture_state_machine_finger(slot, events, numEvents, pCurTime) == -1)
 		{
-			finger->state.state = UNUSED;
-			list = g_list_next(list);
-			sFingers = g_list_remove(sFingers, finger);
-			g_queue_push_tail(&availableFingers, finger);
+			sTracker.state[slot].state = UNUSED;
+			sTracker.active[i] = sTracker.active[--sTracker.numActive];
 		}
 		else
 		{
-			list = g_list_next(list);
+			i++;
 		}
 	}
 
-	if (0 < *numEvents)
+	/* the list may hold earlier frames of the batch, only close this one
+	 * if it added events */
+	if (firstEvent < *numEvents)
 	{
 		//ASSERT(numEvents < MAX_EVENTS_PER_UPDATE);
 		/* add EV_SYN event */
 		set_event_params(&events[(*numEvents)++], (time_stamp_t *) pCurTime, EV_SYN, 0,
 		                 0);
 	}
+
+	gesture_recognizer_frame(pCurTime, events, numEvents);
 }
 
-int gesture_state_machine_finger(finger_t *finger, input_event_t *events,
-                                 int *numEvents)
+static int gesture_state_machine_finger(int slot, input_event_t *events,
+                                        int *numEvents, const time_stamp_t *pCurTime)
 {
-	int x, y;
+	int x, y, xVelocity, yVelocity;
 	time_stamp_t timestamp;
+	gesture_state_data_t *pState = &sTracker.state[slot];
+	/* only moves are predicted, touch down and release land where sampled */
+	bool predict = (START_STATE != pState->state && sTracker.match[slot] >= 0);
 
-	get_last_coords(&finger->coords, &x, &y, &timestamp);
+	get_last_coords(&sTracker.coords[slot], &x, &y, &timestamp);
 
-	finger->numEvents = *numEvents;
-	finger->events = events;
+	set_event_params(&events[(*numEvents)++], &timestamp, EV_FINGERID,
+	                 0 , sTracker.id[slot]);
 
-	set_event_params(&finger->events[finger->numEvents++], &timestamp, EV_FINGERID,
-	                 0 , finger->id);
+	gesture_recognizer_finger(pState, sTracker.id[slot], &sTracker.coords[slot],
+	                          START_STATE == pState->state, sTracker.match[slot] < 0,
+	                          pCurTime);
 
-	switch (finger->state.state)
+	switch (pState->state)
 	{
 		case START_STATE:
 		{
-			finger->state.start[X_DIM] = x;
-			finger->state.start[Y_DIM] = y;
-			finger->state.startTime = timestamp;
-			finger->state.state = FINGER_DOWN_STATE;
-			set_event_params(&finger->events[finger->numEvents++], &timestamp, EV_KEY,
+			pState->state = FINGER_DOWN_STATE;
+			set_event_params(&events[(*numEvents)++], &timestamp, EV_KEY,
 			                 BTN_TOUCH, 1);
 		}
 		break;
@@ -465,25 +744,330 @@ int gesture_state_machine_finger(finger_t *finger, input_event_t *events,
 			break;
 	}
 
-	set_event_params(&finger->events[finger->numEvents++], &timestamp, EV_ABS,
+	if (predict)
+	{
+		get_predicted_coords(&sTracker.coords[slot], spGeneralSettings->predictionMs,
+		                     &x, &y);
+	}
+
+	set_event_params(&events[(*numEvents)++], &timestamp, EV_ABS,
 	                 ABS_X, x);
-	set_event_params(&finger->events[finger->numEvents++], &timestamp, EV_ABS,
+	set_event_params(&events[(*numEvents)++], &timestamp, EV_ABS,
 	                 ABS_Y, y);
-	*numEvents = finger->numEvents;
 
-	if (finger->minDist > 0)
+	get_velocity(&sTracker.coords[slot], &xVelocity, &yVelocity);
+	set_event_params(&events[(*numEvents)++], &timestamp, EV_VELOCITY,
+	                 X_DIM, xVelocity);
+	set_event_params(&events[(*numEvents)++], &timestamp, EV_VELOCITY,
+	                 Y_DIM, yVelocity);
+
+	if (sTracker.match[slot] < 0)
 	{
 		//send finger release event
 		nyx_info("Finger up at %d,%d\n", x, y);
-		set_event_params(&finger->events[finger->numEvents++], &timestamp, EV_KEY,
+		set_event_params(&events[(*numEvents)++], &timestamp, EV_KEY,
 		                 BTN_TOUCH, 0);
-		*numEvents = finger->numEvents;
 		return -1;
 	}
-	else
+
+	return 0;
+}
+
+/**
+ * Queue a gesture for the end of the frame, NULL if too many were found.
+ */
+static pending_gesture_t *
+add_gesture(gesture_key_t key, uint32_t id, int x, int y,
+            const time_stamp_t *pTime)
+{
+	pending_gesture_t *pGesture;
+
+	if (sRecognizer.numPending == MAX_GESTURES_PER_FRAME)
 	{
-		finger->minDist = INT_MAX;
+		nyx_debug("Dropping gesture %d of finger %u\n", key, id);
+		return NULL;
 	}
 
-	return 0;
+	pGesture = &sRecognizer.pending[sRecognizer.numPending++];
+	pGesture->key = key;
+	pGesture->id = id;
+	pGesture->x = x;
+	pGesture->y = y;
+	pGesture->xVelocity = 0;
+	pGesture->yVelocity = 0;
+	pGesture->scale = 1000;
+	pGesture->time = *pTime;
+
+	return pGesture;
+}
+
+static inline int64_t
+distance_squared(int x0, int y0, int x1, int y1)
+{
+	int64_t dx = x1 - x0;
+	int64_t dy = y1 - y0;
+
+	return dx * dx + dy * dy;
+}
+
+/**
+ * Keep the position of every finger down, which pinches are measured on.
+ */
+static void
+track_recognizer_finger(uint32_t id, int x, int y, bool up)
+{
+	int i;
+
+	for (i = 0; i < sRecognizer.numFingers; i++)
+	{
+		if (sRecognizer.fingerId[i] == id)
+		{
+			break;
+		}
+	}
+
+	if (up)
+	{
+		if (i < sRecognizer.numFingers)
+		{
+			int last = --sRecognizer.numFingers;
+
+			sRecognizer.fingerId[i] = sRecognizer.fingerId[last];
+			sRecognizer.fingerX[i] = sRecognizer.fingerX[last];
+			sRecognizer.fingerY[i] = sRecognizer.fingerY[last];
+		}
+
+		return;
+	}
+
+	if (i == sRecognizer.numFingers)
+	{
+		if (i == MAX_TRACKED_FINGERS)
+		{
+			return;
+		}
+
+		sRecognizer.fingerId[sRecognizer.numFingers++] = id;
+	}
+
+	sRecognizer.fingerX[i] = x;
+	sRecognizer.fingerY[i] = y;
+}
+
+/**
+ *******************************************************************************
+ * @brief Feed a finger of the current frame to the gesture recognizer
+ *
+ * Taps, double taps, long presses and flicks are found from the coordinate
+ * history of the finger. A long press is reported with the first frame of
+ * the finger past the hold time, so a finger the panel stops reporting is
+ * only caught once it moves or comes up.
+ *
+ * @param  pState       IN/OUT  recognizer state of the finger
+ * @param  id           IN      finger id reported with EV_FINGERID
+ * @param  pCoordBuf    IN      coordinate history of the finger
+ * @param  down         IN      the finger just touched down
+ * @param  up           IN      the finger is being released
+ * @param  pTime        IN      time of the frame
+ *******************************************************************************
+ */
+void
+gesture_recognizer_finger(gesture_state_data_t *pState, uint32_t id,
+                          const coord_buf_t *pCoordBuf, bool down, bool up,
+                          const time_stamp_t *pTime)
+{
+	int x, y, xVelocity, yVelocity;
+	int64_t tapRadius, heldMs;
+
+	if (!spGeneralSettings->gesturesEnabled)
+	{
+		return;
+	}
+
+	get_last_coords(pCoordBuf, &x, &y, NULL);
+	tapRadius = spGeneralSettings->tapRadius;
+
+	if (down)
+	{
+		pState->start[X_DIM] = x;
+		pState->start[Y_DIM] = y;
+		pState->startTime = *pTime;
+		pState->insideTapRadius = true;
+		pState->longPressed = false;
+	}
+	else if (pState->insideTapRadius &&
+	         distance_squared(pState->start[X_DIM], pState->start[Y_DIM], x, y) >
+	         tapRadius * tapRadius)
+	{
+		pState->insideTapRadius = false;
+	}
+
+	track_recognizer_finger(id, x, y, up);
+
+	heldMs = (time_stamp_usec(pTime) - time_stamp_usec(&pState->startTime)) / 1000;
+
+	/* the fingers of a pinch do not tap or flick on release */
+	if (sRecognizer.pinched &&
+	        (id == sRecognizer.pinchId[0] || id == sRecognizer.pinchId[1]))
+	{
+		return;
+	}
+
+	if (!up)
+	{
+		if (pState->insideTapRadius && !pState->longPressed &&
+		        heldMs >= spGeneralSettings->longPressMs)
+		{
+			pState->longPressed = true;
+			add_gesture(GESTURE_LONG_PRESS, id, pState->start[X_DIM],
+			            pState->start[Y_DIM], pTime);
+		}
+
+		return;
+	}
+
+	if (pState->insideTapRadius)
+	{
+		if (pState->longPressed || heldMs > spGeneralSettings->tapTimeoutMs)
+		{
+			return;
+		}
+
+		add_gesture(GESTURE_TAP, id, pState->start[X_DIM], pState->start[Y_DIM],
+		            pTime);
+
+		if (sRecognizer.lastTapValid &&
+		        (time_stamp_usec(pTime) - time_stamp_usec(&sRecognizer.lastTapTime)) / 1000 <=
+		        spGeneralSettings->doubleTapMs &&
+		        distance_squared(sRecognizer.lastTap[X_DIM], sRecognizer.lastTap[Y_DIM],
+		                         pState->start[X_DIM], pState->start[Y_DIM]) <=
+		        tapRadius * tapRadius)
+		{
+			/* a third tap starts over */
+			sRecognizer.lastTapValid = false;
+			add_gesture(GESTURE_DOUBLE_TAP, id, pState->start[X_DIM],
+			            pState->start[Y_DIM], pTime);
+			return;
+		}
+
+		sRecognizer.lastTapValid = true;
+		sRecognizer.lastTap[X_DIM] = pState->start[X_DIM];
+		sRecognizer.lastTap[Y_DIM] = pState->start[Y_DIM];
+		sRecognizer.lastTapTime = *pTime;
+		return;
+	}
+
+	get_velocity(pCoordBuf, &xVelocity, &yVelocity);
+
+	if (distance_squared(0, 0, xVelocity, yVelocity) >=
+	        (int64_t) spGeneralSettings->flickVelocity * spGeneralSettings->flickVelocity)
+	{
+		pending_gesture_t *pGesture = add_gesture(GESTURE_FLICK, id, x, y, pTime);
+
+		if (NULL != pGesture)
+		{
+			pGesture->xVelocity = xVelocity;
+			pGesture->yVelocity = yVelocity;
+		}
+	}
+}
+
+/**
+ * Report a pinch step whenever the span of exactly two fingers down has
+ * changed by the pinch threshold since the previous step.
+ */
+static void
+recognize_pinch(const time_stamp_t *pTime)
+{
+	pending_gesture_t *pGesture;
+	int span;
+
+	if (2 != sRecognizer.numFingers)
+	{
+		sRecognizer.pinchSpan = 0;
+		return;
+	}
+
+	span = (int) sqrt((double) distance_squared(sRecognizer.fingerX[0],
+	                  sRecognizer.fingerY[0], sRecognizer.fingerX[1],
+	                  sRecognizer.fingerY[1]));
+
+	/* a new pair of fingers sets the span the steps are measured from */
+	if (0 == sRecognizer.pinchSpan ||
+	        sRecognizer.pinchId[0] != sRecognizer.fingerId[0] ||
+	        sRecognizer.pinchId[1] != sRecognizer.fingerId[1])
+	{
+		sRecognizer.pinchId[0] = sRecognizer.fingerId[0];
+		sRecognizer.pinchId[1] = sRecognizer.fingerId[1];
+		sRecognizer.pinchSpan = MAX(span, 1);
+		sRecognizer.pinched = false;
+		return;
+	}
+
+	if (abs(span - sRecognizer.pinchSpan) < spGeneralSettings->pinchThreshold)
+	{
+		return;
+	}
+
+	pGesture = add_gesture(GESTURE_PINCH, sRecognizer.fingerId[0],
+	                       (sRecognizer.fingerX[0] + sRecognizer.fingerX[1]) / 2,
+	                       (sRecognizer.fingerY[0] + sRecognizer.fingerY[1]) / 2, pTime);
+
+	if (NULL != pGesture)
+	{
+		pGesture->scale = (int)((int64_t) span * 1000 / sRecognizer.pinchSpan);
+	}
+
+	sRecognizer.pinchSpan = MAX(span, 1);
+	sRecognizer.pinched = true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Append the gestures recognized in the current frame
+ *
+ * Each gesture becomes a frame of its own, EV_GESTURE followed by its
+ * position, velocity and scale and an EV_SYN, placed after the frame of
+ * touch events it was recognized from. At most MAX_GESTURE_EVENTS events
+ * are added, none without a pending gesture.
+ *
+ * @param  pTime        IN      time of the frame
+ * @param  events       IN/OUT  event list, after the EV_SYN of the frame
+ * @param  numEvents    IN/OUT  number of events in the list
+ *******************************************************************************
+ */
+void
+gesture_recognizer_frame(const time_stamp_t *pTime, input_event_t *events,
+                         int *numEvents)
+{
+	int i;
+
+	if (!spGeneralSettings->gesturesEnabled)
+	{
+		return;
+	}
+
+	recognize_pinch(pTime);
+
+	for (i = 0; i < sRecognizer.numPending; i++)
+	{
+		pending_gesture_t *pGesture = &sRecognizer.pending[i];
+
+		set_event_params(&events[(*numEvents)++], &pGesture->time, EV_GESTURE,
+		                 pGesture->key, pGesture->id);
+		set_event_params(&events[(*numEvents)++], &pGesture->time, EV_ABS,
+		                 ABS_X, pGesture->x);
+		set_event_params(&events[(*numEvents)++], &pGesture->time, EV_ABS,
+		                 ABS_Y, pGesture->y);
+		set_event_params(&events[(*numEvents)++], &pGesture->time, EV_VELOCITY,
+		                 X_DIM, pGesture->xVelocity);
+		set_event_params(&events[(*numEvents)++], &pGesture->time, EV_VELOCITY,
+		                 Y_DIM, pGesture->yVelocity);
+		set_event_params(&events[(*numEvents)++], &pGesture->time, EV_SCALE,
+		                 0, pGesture->scale);
+		set_event_params(&events[(*numEvents)++], &pGesture->time, EV_SYN,
+		                 0, 0);
+	}
+
+	sRecognizer.numPending = 0;
 }
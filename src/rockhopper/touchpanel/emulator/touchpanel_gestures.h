@@ -30,6 +30,9 @@ typedef         __u32           uint32_t;
 
 
 #define EV_FINGERID 0x07
+#define EV_VELOCITY 0x08    /**< code X_DIM/Y_DIM, value in pixels per second */
+#define EV_GESTURE  0x09    /**< code gesture_key_t, value finger id */
+#define EV_SCALE    0x0a    /**< pinch span relative to the previous step, in 1/1000 */
 
 typedef struct time_stamp
 {
@@ -53,6 +56,12 @@ typedef struct interrupt_on_touch_settings
 } interrupt_on_touch_settings_t;
 
 
+typedef enum
+{
+    FILTER_NONE = 0,            /**< report positions as sampled */
+    FILTER_ONE_EURO,            /**< speed adaptive low pass (1 euro filter) */
+} filter_mode_t;
+
 typedef struct general_settings
 {
 	int coordBufSize;           /**< size of coordinate circular buffer to calculate
@@ -60,6 +69,22 @@ typedef struct general_settings
 	int fingerDownThreshold;            /**< threshold to accept finger as down -- access atomically */
 
 	int positionFilter;
+
+	filter_mode_t filterMode;
+	double filterMinCutoff;     /**< Hz, cutoff of a finger at rest */
+	double filterBeta;          /**< cutoff increase per pixel/s of speed */
+	double filterDCutoff;       /**< Hz, cutoff of the speed estimate */
+
+	int predictionMs;           /**< report moves this far ahead, 0 disables */
+
+	bool gesturesEnabled;       /**< report recognized gestures */
+	int tapRadius;              /**< pixels a finger may wander and still tap */
+	int tapTimeoutMs;           /**< longest touch reported as a tap */
+	int doubleTapMs;            /**< longest gap between the taps of a double tap */
+	int longPressMs;            /**< hold time of a long press */
+	int flickVelocity;          /**< pixels per second a release needs to flick */
+	int pinchThreshold;         /**< change of the finger span, in pixels, reported
+                                     as one pinch step */
 } general_settings_t;
 
 typedef struct coord
@@ -69,6 +94,12 @@ typedef struct coord
 	time_stamp_t timeStamp;   /**< time of the coordinates */
 } coord_t;
 
+typedef struct one_euro_state
+{
+	double value;           /**< filtered position */
+	double deriv;           /**< filtered speed, pixels per second */
+} one_euro_state_t;
+
 typedef struct coord_buf
 {
 	coord_t *pCoords;       /**< array of coords */
@@ -76,6 +107,18 @@ typedef struct coord_buf
 	int tail;               /**< index of end of items in the array  */
 	int numItems;           /**< number of items in the array */
 	int size;               /**< total size of coord array */
+
+	/* running sums for the least-squares velocity, times in usec relative
+	 * to refTime, the time of the oldest item */
+	int64_t refTime;
+	int64_t sumT;
+	int64_t sumTT;
+	int64_t sumX;
+	int64_t sumY;
+	int64_t sumTX;
+	int64_t sumTY;
+
+	one_euro_state_t filter[2]; /**< x and y filter state */
 } coord_buf_t;
 
 typedef enum
@@ -96,9 +139,20 @@ typedef struct gesture_state_data
 	gesture_state_t state;
 	int start[NUM_DIMENSIONS];
 	bool insideTapRadius;
+	bool longPressed;           /**< long press already reported */
 	time_stamp_t startTime;
 } gesture_state_data_t;
 
+/* gestureKey of NYX_TOUCHPANEL_EVENT_TYPE_GESTURE events */
+typedef enum
+{
+    GESTURE_TAP = 0,            /**< short touch that stayed in the tap radius */
+    GESTURE_DOUBLE_TAP,         /**< second tap, reported after its GESTURE_TAP */
+    GESTURE_LONG_PRESS,         /**< finger held in the tap radius */
+    GESTURE_FLICK,              /**< fast release, velocity of the finger */
+    GESTURE_PINCH,              /**< two finger span step, scale in weight */
+} gesture_key_t;
+
 typedef struct
 {
 	struct timeval time;  /**< time event was generated */
@@ -107,20 +161,50 @@ typedef struct
 	int32_t value;        /**< event value: coordinate, intensity,etc. */
 } input_event_t;
 
-typedef struct finger
-{
-	coord_buf_t coords;
-	time_stamp_t timestamp;
-	uint32_t id;
-	gesture_state_data_t state;
-	int minDist;
-	int minDistId;
-	int lastWeight;
-	int numEvents;
-	input_event_t *events;
-} finger_t;
+#define MAX_TRACKED_FINGERS     10
+
+/* finger id, down, x, y, x/y velocity and up */
+#define MAX_EVENTS_PER_FINGER   7
 
+/* gesture, x, y, x/y velocity, scale and EV_SYN */
+#define MAX_EVENTS_PER_GESTURE  7
 
+/* gestures reported after a single frame, further ones are dropped */
+#define MAX_GESTURES_PER_FRAME  8
+
+#define MAX_GESTURE_EVENTS      (MAX_GESTURES_PER_FRAME * MAX_EVENTS_PER_GESTURE)
+
+/**
+ * Fixed capacity finger tracker. Per-finger data is kept as parallel arrays
+ * indexed by slot, so matching only walks the last known positions, and all
+ * coordinate histories share a single allocation.
+ */
+typedef struct finger_tracker
+{
+	int numSlots;                               /**< usable slots */
+	int numActive;                              /**< number of tracked fingers */
+	int active[MAX_TRACKED_FINGERS];            /**< slots of the tracked fingers */
+	int lastX[MAX_TRACKED_FINGERS];             /**< last coordinate per slot */
+	int lastY[MAX_TRACKED_FINGERS];
+	int lastWeight[MAX_TRACKED_FINGERS];
+	int match[MAX_TRACKED_FINGERS];             /**< input matched to the slot, -1 if none */
+	uint32_t id[MAX_TRACKED_FINGERS];
+	gesture_state_data_t state[MAX_TRACKED_FINGERS];
+	coord_buf_t coords[MAX_TRACKED_FINGERS];
+	coord_t *pCoordArena;                       /**< backing store of all coords */
+} finger_tracker_t;
+
+
+int init_coord_buffer(coord_buf_t *pCoordBuf, coord_t *pCoords, int bufSize);
+void reset_coord_buffer(coord_buf_t *pCoordBuf);
+void update_coord_buffer(coord_buf_t *pCoordBuf, int xCoord, int yCoord,
+                         const time_stamp_t *pTime);
+void get_velocity(const coord_buf_t *pCoordBuf, int *pXVelocity,
+                  int *pYVelocity);
+void get_last_coords(const coord_buf_t *pCoordBuf, int *xCoord, int *yCoord,
+                     time_stamp_t *timestamp);
+void get_predicted_coords(const coord_buf_t *pCoordBuf, int aheadMs,
+                          int *xCoord, int *yCoord);
 
 void init_gesture_state_machine(const general_settings_t *pGeneralSettings,
                                 int maxFingers);
@@ -130,4 +214,10 @@ void gesture_state_machine(int *pXCoords, int *pYCoords,
                            int fingerCount, const time_stamp_t *pTime,
                            input_event_t *events, int *numEvents);
 
+void gesture_recognizer_finger(gesture_state_data_t *pState, uint32_t id,
+                               const coord_buf_t *pCoordBuf, bool down, bool up,
+                               const time_stamp_t *pTime);
+void gesture_recognizer_frame(const time_stamp_t *pTime, input_event_t *events,
+                              int *numEvents);
+
 #endif  /* __TOUCHPANEL_GESTURES_PRV_H */
@@ -0,0 +1,156 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <nyx/module/nyx_log.h>
+
+#include "touchpanel_shm.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC     0x0001U
+#endif
+
+/**
+ *******************************************************************************
+ * @brief Create and map the shared frame ring and its eventfd
+ *
+ * @param  pShm     OUT     ring to set up
+ *
+ * @retval 0 on success, -1 with nothing left to clean up on error
+ *******************************************************************************
+ */
+int
+touch_shm_create(touch_shm_t *pShm)
+{
+	void *pMap;
+
+	pShm->pRing = NULL;
+	pShm->wakeFd = -1;
+	pShm->memFd = syscall(SYS_memfd_create, "nyx-touchpanel", MFD_CLOEXEC);
+
+	if (pShm->memFd < 0)
+	{
+		nyx_error("Failed to create the touch frame memfd (%d)", errno);
+		return -1;
+	}
+
+	if (ftruncate(pShm->memFd, TOUCH_SHM_SIZE) < 0)
+	{
+		goto error;
+	}
+
+	pMap = mmap(NULL, TOUCH_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+	            pShm->memFd, 0);
+
+	if (MAP_FAILED == pMap)
+	{
+		goto error;
+	}
+
+	pShm->pRing = (touch_shm_ring_t *) pMap;
+	pShm->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (pShm->wakeFd < 0)
+	{
+		goto error;
+	}
+
+	pShm->pRing->version = TOUCH_SHM_VERSION;
+	pShm->pRing->numFrames = TOUCH_SHM_FRAMES;
+	pShm->pRing->maxItems = TOUCH_SHM_MAX_ITEMS;
+	__atomic_store_n(&pShm->pRing->magic, TOUCH_SHM_MAGIC, __ATOMIC_RELEASE);
+
+	return 0;
+
+error:
+	nyx_error("Failed to set up the touch frame ring (%d)", errno);
+	touch_shm_destroy(pShm);
+	return -1;
+}
+
+void
+touch_shm_destroy(touch_shm_t *pShm)
+{
+	if (NULL != pShm->pRing)
+	{
+		munmap(pShm->pRing, TOUCH_SHM_SIZE);
+		pShm->pRing = NULL;
+	}
+
+	if (pShm->memFd >= 0)
+	{
+		close(pShm->memFd);
+		pShm->memFd = -1;
+	}
+
+	if (pShm->wakeFd >= 0)
+	{
+		close(pShm->wakeFd);
+		pShm->wakeFd = -1;
+	}
+}
+
+/**
+ * Claim the next frame slot, marking it as being written
+ */
+touch_shm_frame_t *
+touch_shm_begin_frame(touch_shm_t *pShm)
+{
+	touch_shm_ring_t *pRing = pShm->pRing;
+	uint64_t n = pRing->writeSeq;
+	touch_shm_frame_t *pFrame = &pRing->frames[n % TOUCH_SHM_FRAMES];
+
+	__atomic_store_n(&pFrame->seq, 2 * n + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	return pFrame;
+}
+
+/**
+ * Complete the frame claimed by touch_shm_begin_frame() and publish it
+ */
+void
+touch_shm_end_frame(touch_shm_t *pShm)
+{
+	touch_shm_ring_t *pRing = pShm->pRing;
+	uint64_t n = pRing->writeSeq;
+
+	__atomic_store_n(&pRing->frames[n % TOUCH_SHM_FRAMES].seq, 2 * (n + 1),
+	                 __ATOMIC_RELEASE);
+	__atomic_store_n(&pRing->writeSeq, n + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Wake the client after a batch of frames has been published
+ */
+void
+touch_shm_notify(touch_shm_t *pShm)
+{
+	uint64_t one = 1;
+
+	if (write(pShm->wakeFd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN)
+	{
+		nyx_error("Failed to signal the touch frame ring");
+	}
+}
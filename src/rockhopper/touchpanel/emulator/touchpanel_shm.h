@@ -0,0 +1,149 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#ifndef __TOUCHPANEL_SHM_H
+#define __TOUCHPANEL_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TOUCH_SHM_MAGIC     0x48535054  /* "TPSH" */
+#define TOUCH_SHM_VERSION   1
+
+/* Frames in the ring, a power of two */
+#define TOUCH_SHM_FRAMES    256
+
+/* Items per frame, as many as a nyx touch event holds */
+#define TOUCH_SHM_MAX_ITEMS 10
+
+typedef struct touch_shm_item
+{
+	int32_t finger;
+	int32_t state;          /**< nyx_touchpanel_state_t */
+	int32_t x;
+	int32_t y;
+	int32_t gestureKey;
+	int32_t scale;          /**< pinch scale in 1/1000, 0 if none */
+	int32_t xVelocity;      /**< pixels per second */
+	int32_t yVelocity;
+	int64_t timestamp;      /**< ns on the event clock */
+} touch_shm_item_t;
+
+/**
+ * One touch frame. seq is odd while the module writes the frame and
+ * 2 * (n + 1) once frame number n is complete, so a reader can tell a
+ * frame that was overwritten under it.
+ */
+typedef struct touch_shm_frame
+{
+	uint64_t seq;
+	int32_t type;           /**< nyx_touchpanel_event_type_t */
+	int32_t itemCount;
+	touch_shm_item_t items[TOUCH_SHM_MAX_ITEMS];
+} touch_shm_frame_t;
+
+/**
+ * Layout of the shared memory: this header followed by TOUCH_SHM_FRAMES
+ * frames. The module publishes frame n in frames[n % numFrames] and then
+ * sets writeSeq to n + 1 and signals the eventfd.
+ */
+typedef struct touch_shm_ring
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numFrames;
+	uint32_t maxItems;
+	uint64_t writeSeq;      /**< frames published so far */
+	uint8_t reserved[40];   /**< pad the header to a cache line */
+	touch_shm_frame_t frames[];
+} touch_shm_ring_t;
+
+#define TOUCH_SHM_SIZE  (sizeof(touch_shm_ring_t) + \
+                         TOUCH_SHM_FRAMES * sizeof(touch_shm_frame_t))
+
+/*
+ * Client side. A reader keeps the number of the next frame it wants and
+ * walks up to writeSeq:
+ *
+ *   uint64_t end = touch_shm_available(ring, &next, &lost);
+ *   for (; next < end; next++) {
+ *       const touch_shm_frame_t *frame = touch_shm_frame(ring, next);
+ *       if (!touch_shm_frame_begin(frame, next)) continue;
+ *       ... read frame in place ...
+ *       if (!touch_shm_frame_end(frame, next)) discard what was read;
+ *   }
+ */
+
+/**
+ * Return the sequence number past the last published frame. Frames the
+ * module already overwrote are skipped, moving *pNext up and adding them to
+ * *pLost.
+ */
+static inline uint64_t
+touch_shm_available(const touch_shm_ring_t *pRing, uint64_t *pNext,
+                    uint64_t *pLost)
+{
+	uint64_t end = __atomic_load_n(&pRing->writeSeq, __ATOMIC_ACQUIRE);
+
+	if (end - *pNext > pRing->numFrames)
+	{
+		*pLost += end - *pNext - pRing->numFrames;
+		*pNext = end - pRing->numFrames;
+	}
+
+	return end;
+}
+
+static inline const touch_shm_frame_t *
+touch_shm_frame(const touch_shm_ring_t *pRing, uint64_t n)
+{
+	return &pRing->frames[n % pRing->numFrames];
+}
+
+/* false if frame number n has already been overwritten */
+static inline bool
+touch_shm_frame_begin(const touch_shm_frame_t *pFrame, uint64_t n)
+{
+	return __atomic_load_n(&pFrame->seq, __ATOMIC_ACQUIRE) == 2 * (n + 1);
+}
+
+/* false if frame number n was overwritten while it was being read */
+static inline bool
+touch_shm_frame_end(const touch_shm_frame_t *pFrame, uint64_t n)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&pFrame->seq, __ATOMIC_RELAXED) == 2 * (n + 1);
+}
+
+/* Module side */
+typedef struct touch_shm
+{
+	touch_shm_ring_t *pRing;
+	int memFd;
+	int wakeFd;             /**< eventfd signalled when frames are published */
+} touch_shm_t;
+
+int touch_shm_create(touch_shm_t *pShm);
+void touch_shm_destroy(touch_shm_t *pShm);
+touch_shm_frame_t *touch_shm_begin_frame(touch_shm_t *pShm);
+void touch_shm_end_frame(touch_shm_t *pShm);
+void touch_shm_notify(touch_shm_t *pShm);
+
+#endif  /* __TOUCHPANEL_SHM_H */
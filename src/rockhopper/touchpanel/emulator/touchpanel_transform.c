@@ -0,0 +1,123 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <nyx/module/nyx_log.h>
+
+#include "touchpanel_transform.h"
+
+#define Q16(num, den)   (((int64_t)(num) * ((int64_t)1 << TRANSFORM_FRAC_BITS)) / (den))
+
+/**
+ *******************************************************************************
+ * @brief Set up a plain scaling transform from the panel range to the display
+ *
+ * @param  pTransform   OUT     transform to initialize
+ * @param  panelMaxX    IN      maximum x reported by the panel
+ * @param  panelMaxY    IN      maximum y reported by the panel
+ * @param  displayX     IN      horizontal display resolution
+ * @param  displayY     IN      vertical display resolution
+ *******************************************************************************
+ */
+void
+transform_init_scale(touch_transform_t *pTransform, int panelMaxX,
+                     int panelMaxY, int displayX, int displayY)
+{
+	memset(pTransform, 0, sizeof(touch_transform_t));
+
+	pTransform->xx = (panelMaxX > 0) ? Q16(displayX, panelMaxX) : Q16(1, 1);
+	pTransform->yy = (panelMaxY > 0) ? Q16(displayY, panelMaxY) : Q16(1, 1);
+}
+
+/**
+ *******************************************************************************
+ * @brief Load a calibration matrix in tslib pointercal format
+ *
+ * The file holds seven integers "a b c d e f s", mapping panel to display
+ * coordinates (including any rotation) as x' = (a * x + b * y + c) / s and
+ * y' = (d * x + e * y + f) / s.
+ *
+ * @param  pTransform   OUT     transform to initialize
+ * @param  pPath        IN      calibration file
+ *
+ * @retval  0 on success
+ * @retval -1 if the file is missing or malformed, pTransform is untouched
+ *******************************************************************************
+ */
+int
+transform_load_calibration(touch_transform_t *pTransform, const char *pPath)
+{
+	long a, b, c, d, e, f, s;
+	FILE *fp = fopen(pPath, "r");
+
+	if (NULL == fp)
+	{
+		return -1;
+	}
+
+	if (fscanf(fp, "%ld %ld %ld %ld %ld %ld %ld", &a, &b, &c, &d, &e, &f,
+	           &s) != 7 || s == 0)
+	{
+		nyx_error("Invalid calibration data in %s", pPath);
+		fclose(fp);
+		return -1;
+	}
+
+	fclose(fp);
+
+	pTransform->xx = Q16(a, s);
+	pTransform->xy = Q16(b, s);
+	pTransform->x0 = Q16(c, s);
+	pTransform->yx = Q16(d, s);
+	pTransform->yy = Q16(e, s);
+	pTransform->y0 = Q16(f, s);
+
+	return 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Transform a batch of points in place
+ *
+ * Integer only and free of branches so the compiler can vectorize it.
+ *
+ * @param  pTransform   IN      transform to apply
+ * @param  pXCoords     IN/OUT  x coordinates
+ * @param  pYCoords     IN/OUT  y coordinates
+ * @param  count        IN      number of points
+ *******************************************************************************
+ */
+void
+transform_points(const touch_transform_t *pTransform, int32_t *pXCoords,
+                 int32_t *pYCoords, int count)
+{
+	const int64_t xx = pTransform->xx, xy = pTransform->xy, x0 = pTransform->x0;
+	const int64_t yx = pTransform->yx, yy = pTransform->yy, y0 = pTransform->y0;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		int64_t x = pXCoords[i];
+		int64_t y = pYCoords[i];
+
+		pXCoords[i] = (int32_t)((xx * x + xy * y + x0) >> TRANSFORM_FRAC_BITS);
+		pYCoords[i] = (int32_t)((yx * x + yy * y + y0) >> TRANSFORM_FRAC_BITS);
+	}
+}
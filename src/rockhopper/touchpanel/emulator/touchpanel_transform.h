@@ -0,0 +1,44 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#ifndef __TOUCHPANEL_TRANSFORM_H
+#define __TOUCHPANEL_TRANSFORM_H
+
+#include <stdint.h>
+
+#define TRANSFORM_FRAC_BITS     16
+
+/**
+ * Affine transform from panel to display coordinates, coefficients in Q16:
+ *   x' = (xx * x + xy * y + x0) >> 16
+ *   y' = (yx * x + yy * y + y0) >> 16
+ */
+typedef struct touch_transform
+{
+	int64_t xx, xy, x0;
+	int64_t yx, yy, y0;
+} touch_transform_t;
+
+void transform_init_scale(touch_transform_t *pTransform, int panelMaxX,
+                          int panelMaxY, int displayX, int displayY);
+int transform_load_calibration(touch_transform_t *pTransform,
+                               const char *pPath);
+void transform_points(const touch_transform_t *pTransform, int32_t *pXCoords,
+                      int32_t *pYCoords, int count);
+
+#endif  /* __TOUCHPANEL_TRANSFORM_H */
@@ -0,0 +1,267 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/**
+ * @file sysfs_bench.c
+ *
+ * @brief Compares reads of small sysfs attributes through FileGetString()
+ * and FileGetDouble(), see utils.h, with the cached descriptor reads of
+ * sysfs_attr.h. Without a directory the attributes are synthesized as
+ * regular files, so it runs on any Linux box. Built with
+ * -DBUILD_BENCHMARKS=YES for devices other than the emulator.
+ *
+ * Usage: sysfs_bench [-n reads] [directory]
+ *   -n    reads per case (default 100000)
+ *
+ * Given a power_supply directory such as /sys/class/power_supply/BAT0, its
+ * voltage_now and status attributes are read instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "sysfs_attr.h"
+
+#define BENCH_VALUE_LEN     64
+
+static const char *const status_names[] =
+{
+	"Unknown", "Charging", "Discharging", "Not charging", "Full"
+};
+
+#define NUM_STATUS  (sizeof(status_names) / sizeof(status_names[0]))
+
+/* Attributes written when no directory is given */
+static const struct
+{
+	const char *name;
+	const char *value;
+} synthesized[] =
+{
+	{ "voltage_now", "4123456\n" },
+	{ "charge_full", "2950.125\n" },
+	{ "status", "Charging\n" },
+};
+
+#define NUM_SYNTHESIZED (sizeof(synthesized) / sizeof(synthesized[0]))
+
+static double
+now_seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int
+write_attr(const char *dir, const char *name, const char *value)
+{
+	char path[256];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+	file = fopen(path, "w");
+	if (!file)
+	{
+		return -1;
+	}
+
+	fputs(value, file);
+
+	return fclose(file);
+}
+
+static void
+report(const char *name, double helper, double attr, int reads)
+{
+	printf("%-8s %10.1f ns/read %10.1f ns/read %8.1fx\n", name,
+	       helper * 1e9 / reads, attr * 1e9 / reads, helper / attr);
+}
+
+int
+main(int argc, char **argv)
+{
+	char tmpdir[] = "/tmp/sysfs_bench.XXXXXX";
+	char number_path[256], fixed_path[256], status_path[256];
+	char buf[BENCH_VALUE_LEN];
+	const char *dir = NULL, *fixed_name = "charge_full";
+	sysfs_attr_t number = SYSFS_ATTR_INIT;
+	sysfs_attr_t fixed = SYSFS_ATTR_INIT;
+	sysfs_attr_t status = SYSFS_ATTR_INIT;
+	int reads = 100000, opt, i, k;
+	double start, helper, attr, dvalue;
+	double checksum = 0;
+	long value;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+				reads = atoi(optarg);
+				break;
+
+			default:
+				fprintf(stderr, "usage: %s [-n reads] [directory]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if (reads < 1)
+	{
+		fprintf(stderr, "reads must be positive\n");
+		return 1;
+	}
+
+	if (optind < argc)
+	{
+		dir = argv[optind];
+		fixed_name = "voltage_now";
+	}
+	else
+	{
+		dir = mkdtemp(tmpdir);
+		if (!dir)
+		{
+			fprintf(stderr, "failed to create %s\n", tmpdir);
+			return 1;
+		}
+
+		for (i = 0; i < (int) NUM_SYNTHESIZED; i++)
+		{
+			if (write_attr(dir, synthesized[i].name, synthesized[i].value) < 0)
+			{
+				fprintf(stderr, "failed to write %s/%s\n", dir, synthesized[i].name);
+				return 1;
+			}
+		}
+	}
+
+	snprintf(number_path, sizeof(number_path), "%s/voltage_now", dir);
+	snprintf(fixed_path, sizeof(fixed_path), "%s/%s", dir, fixed_name);
+	snprintf(status_path, sizeof(status_path), "%s/status", dir);
+
+	if (sysfs_attr_open(&number, dir, "voltage_now") < 0 ||
+	        sysfs_attr_open(&fixed, dir, fixed_name) < 0 ||
+	        sysfs_attr_open(&status, dir, "status") < 0)
+	{
+		fprintf(stderr, "failed to open the attributes of %s\n", dir);
+		return 1;
+	}
+
+	printf("%-8s %18s %18s %9s\n", "case", "FileGet*", "sysfs_attr", "speedup");
+
+	/* text */
+	start = now_seconds();
+	for (i = 0; i < reads; i++)
+	{
+		FileGetString(status_path, buf, sizeof(buf));
+		checksum += buf[0];
+	}
+	helper = now_seconds() - start;
+
+	start = now_seconds();
+	for (i = 0; i < reads; i++)
+	{
+		sysfs_attr_read(&status, buf, sizeof(buf));
+		checksum += buf[0];
+	}
+	attr = now_seconds() - start;
+	report("string", helper, attr, reads);
+
+	/* integer */
+	start = now_seconds();
+	for (i = 0; i < reads; i++)
+	{
+		FileGetDouble(number_path, &dvalue);
+		checksum += dvalue;
+	}
+	helper = now_seconds() - start;
+
+	start = now_seconds();
+	for (i = 0; i < reads; i++)
+	{
+		sysfs_attr_read_int(&number, &value);
+		checksum += value;
+	}
+	attr = now_seconds() - start;
+	report("int", helper, attr, reads);
+
+	/* fixed-point, three fractional digits */
+	start = now_seconds();
+	for (i = 0; i < reads; i++)
+	{
+		FileGetDouble(fixed_path, &dvalue);
+		checksum += (long)(dvalue * 1000);
+	}
+	helper = now_seconds() - start;
+
+	start = now_seconds();
+	for (i = 0; i < reads; i++)
+	{
+		sysfs_attr_read_fixed(&fixed, 3, &value);
+		checksum += value;
+	}
+	attr = now_seconds() - start;
+	report("fixed", helper, attr, reads);
+
+	/* enumeration, matched the way the string was compared before */
+	start = now_seconds();
+	for (i = 0; i < reads; i++)
+	{
+		FileGetString(status_path, buf, sizeof(buf));
+		for (k = 0; k < (int) NUM_STATUS && strcmp(buf, status_names[k]); k++)
+			;
+		checksum += k;
+	}
+	helper = now_seconds() - start;
+
+	start = now_seconds();
+	for (i = 0; i < reads; i++)
+	{
+		checksum += sysfs_attr_read_enum(&status, status_names, NUM_STATUS);
+	}
+	attr = now_seconds() - start;
+	report("enum", helper, attr, reads);
+
+	printf("checksum %.0f\n", checksum);
+
+	sysfs_attr_close(&number);
+	sysfs_attr_close(&fixed);
+	sysfs_attr_close(&status);
+
+	if (dir == tmpdir)
+	{
+		for (i = 0; i < (int) NUM_SYNTHESIZED; i++)
+		{
+			snprintf(number_path, sizeof(number_path), "%s/%s", dir,
+			         synthesized[i].name);
+			unlink(number_path);
+		}
+		rmdir(dir);
+	}
+
+	return 0;
+}
@@ -0,0 +1,270 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/**
+ * @file input_reader.c
+ *
+ * @brief Optional per-device reader threads for the input modules. Decoding
+ * then runs on the reader thread instead of the thread calling get_event,
+ * usually the host main loop.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <nyx/module/nyx_log.h>
+
+#include "input_reader.h"
+
+/* How long a producer facing a full queue waits before retrying, in ms,
+ * after yielding to the consumer a few times */
+#define INPUT_QUEUE_FULL_WAIT   1
+#define INPUT_QUEUE_FULL_YIELDS 64
+
+bool
+input_queue_push(input_queue_t *queue, void *item)
+{
+	unsigned int tail = queue->tail;
+
+	if (tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == INPUT_QUEUE_SIZE)
+	{
+		return false;
+	}
+
+	queue->slots[tail % INPUT_QUEUE_SIZE] = item;
+	__atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+void *
+input_queue_pop(input_queue_t *queue)
+{
+	unsigned int head = queue->head;
+	void *item;
+
+	if (head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE))
+	{
+		return NULL;
+	}
+
+	item = queue->slots[head % INPUT_QUEUE_SIZE];
+	__atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+
+	return item;
+}
+
+bool
+input_reader_enabled(void)
+{
+	const char *value = getenv(INPUT_READER_THREAD_ENV);
+
+	return value && strcmp(value, "1") == 0;
+}
+
+/**
+ * Create the wakeup descriptors and start thread_fn(arg). Returns -1, with
+ * nothing left to clean up, on failure.
+ */
+int
+input_reader_start(input_reader_t *reader, void *(*thread_fn)(void *),
+                   void *arg)
+{
+	memset(reader, 0, sizeof(*reader));
+
+	reader->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	reader->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (reader->wake_fd < 0 || reader->stop_fd < 0)
+	{
+		nyx_error("Failed to create reader thread eventfds");
+		goto error;
+	}
+
+	if (pthread_create(&reader->thread, NULL, thread_fn, arg) != 0)
+	{
+		nyx_error("Failed to start reader thread");
+		goto error;
+	}
+
+	reader->running = true;
+
+	return 0;
+
+error:
+
+	if (reader->wake_fd >= 0)
+	{
+		close(reader->wake_fd);
+	}
+
+	if (reader->stop_fd >= 0)
+	{
+		close(reader->stop_fd);
+	}
+
+	return -1;
+}
+
+/**
+ * Ask the thread to exit and wait for it. Events still queued are left for
+ * the caller to pop and release.
+ */
+void
+input_reader_stop(input_reader_t *reader)
+{
+	uint64_t one = 1;
+
+	if (!reader->running)
+	{
+		return;
+	}
+
+	if (write(reader->stop_fd, &one, sizeof(one)) != sizeof(one))
+	{
+		nyx_error("Failed to signal reader thread");
+	}
+
+	pthread_join(reader->thread, NULL);
+	reader->running = false;
+
+	close(reader->wake_fd);
+	close(reader->stop_fd);
+}
+
+/**
+ * Block the reader thread until fd is readable, or only until it is asked
+ * to stop if fd is negative. Returns false once it has been asked to stop.
+ */
+bool
+input_reader_wait(input_reader_t *reader, int fd)
+{
+	struct pollfd fds[2];
+
+	fds[0].fd = fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = reader->stop_fd;
+	fds[1].events = POLLIN;
+
+	while (poll(fds, 2, -1) < 0)
+	{
+		if (errno != EINTR)
+		{
+			nyx_error("Reader thread failed to poll its input");
+			return false;
+		}
+	}
+
+	return !(fds[1].revents & POLLIN);
+}
+
+/**
+ * Back off while the consumer holds on to what the reader needs, yielding
+ * first and then sleeping INPUT_QUEUE_FULL_WAIT ms at a time. *yields counts
+ * the attempts so far, start it at 0. Returns false once the thread has been
+ * asked to stop.
+ */
+bool
+input_reader_backoff(input_reader_t *reader, int *yields)
+{
+	struct pollfd stop;
+
+	if ((*yields)++ < INPUT_QUEUE_FULL_YIELDS)
+	{
+		sched_yield();
+		return true;
+	}
+
+	*yields = 0;
+	stop.fd = reader->stop_fd;
+	stop.events = POLLIN;
+
+	return poll(&stop, 1, INPUT_QUEUE_FULL_WAIT) <= 0;
+}
+
+/**
+ * Queue an event for the consumer, waiting while the queue is full, and
+ * wake the consumer if it had caught up. Returns false, leaving the event
+ * with the caller, when the thread is asked to stop meanwhile.
+ */
+bool
+input_reader_publish(input_reader_t *reader, void *item)
+{
+	unsigned int tail = reader->ready.tail;
+	int yields = 0;
+	uint64_t one = 1;
+
+	while (!input_queue_push(&reader->ready, item))
+	{
+		if (!input_reader_backoff(reader, &yields))
+		{
+			return false;
+		}
+	}
+
+	/*
+	 * Pairs with the fence in input_reader_consume(): either the consumer
+	 * sees this event after clearing the wakeup, or it had popped everything
+	 * before it and is woken here.
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&reader->ready.head, __ATOMIC_ACQUIRE) != tail)
+	{
+		return true;
+	}
+
+	if (write(reader->wake_fd, &one, sizeof(one)) != sizeof(one) &&
+	        errno != EAGAIN)
+	{
+		nyx_error("Failed to wake the input consumer");
+	}
+
+	return true;
+}
+
+/**
+ * Pop the next queued event, NULL if there is none. The wakeup is cleared
+ * before the queue is looked at, so an event published meanwhile signals
+ * the descriptor again.
+ */
+void *
+input_reader_consume(input_reader_t *reader)
+{
+	uint64_t count;
+	void *item = input_queue_pop(&reader->ready);
+
+	if (NULL == item)
+	{
+		if (read(reader->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		{
+			nyx_error("Failed to clear the input wakeup");
+		}
+
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		item = input_queue_pop(&reader->ready);
+	}
+
+	return item;
+}
@@ -0,0 +1,72 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/**
+ * @file input_reader.h
+ */
+
+#ifndef INPUT_READER_H_
+#define INPUT_READER_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Slots of an input queue, a power of two */
+#define INPUT_QUEUE_SIZE    256
+
+/**
+ * Lock-free single producer, single consumer queue of pointers. The producer
+ * only writes tail and the consumer only writes head; each publishes its
+ * index with release semantics after touching the slots.
+ */
+typedef struct
+{
+	void *slots[INPUT_QUEUE_SIZE];
+	unsigned int head;      /**< next slot to pop, written by the consumer */
+	unsigned int tail;      /**< next slot to push, written by the producer */
+} input_queue_t;
+
+/**
+ * A thread blocking on an input device and handing finished events to the
+ * caller of get_event through a queue, signalling wake_fd when it does.
+ */
+typedef struct
+{
+	pthread_t thread;
+	bool running;
+	int wake_fd;            /**< eventfd, readable while events are queued */
+	int stop_fd;            /**< eventfd asking the thread to exit */
+	input_queue_t ready;    /**< events for the consumer */
+} input_reader_t;
+
+/* Environment variable enabling reader threads */
+#define INPUT_READER_THREAD_ENV     "NYX_INPUT_READER_THREAD"
+
+bool input_reader_enabled(void);
+int input_reader_start(input_reader_t *reader, void *(*thread_fn)(void *),
+                       void *arg);
+void input_reader_stop(input_reader_t *reader);
+bool input_reader_wait(input_reader_t *reader, int fd);
+bool input_reader_backoff(input_reader_t *reader, int *yields);
+bool input_reader_publish(input_reader_t *reader, void *item);
+void *input_reader_consume(input_reader_t *reader);
+
+bool input_queue_push(input_queue_t *queue, void *item);
+void *input_queue_pop(input_queue_t *queue);
+
+#endif // INPUT_READER_H_
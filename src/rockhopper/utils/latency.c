@@ -0,0 +1,106 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/**
+ * @file latency.c
+ *
+ * @brief Input event clock selection and latency bookkeeping shared by the
+ * input device modules.
+ */
+
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include <nyx/module/nyx_log.h>
+
+#include "latency.h"
+
+/**
+ * Ask evdev to stamp the events of fd with CLOCK_MONOTONIC, so latencies are
+ * not skewed by wall clock steps. Returns the clock the events are stamped
+ * with, which stays CLOCK_REALTIME on kernels without EVIOCSCLKID.
+ */
+clockid_t
+input_set_monotonic_clock(int fd)
+{
+#ifdef EVIOCSCLKID
+	int clock = CLOCK_MONOTONIC;
+
+	if (ioctl(fd, EVIOCSCLKID, &clock) == 0)
+	{
+		return CLOCK_MONOTONIC;
+	}
+
+	nyx_warn("Input events stay on the realtime clock");
+#endif
+	return CLOCK_REALTIME;
+}
+
+/**
+ * Time in usec from an event stamped on the given clock until now
+ */
+int64_t
+input_event_latency(clockid_t clock, const struct timeval *time)
+{
+	struct timespec now;
+
+	clock_gettime(clock, &now);
+
+	return (now.tv_sec - time->tv_sec) * 1000000LL +
+	       now.tv_nsec / 1000 - time->tv_usec;
+}
+
+void
+latency_histogram_record(latency_histogram_t *histogram, int64_t usec)
+{
+	int bucket = 0;
+
+	if (usec > 0)
+	{
+		bucket = 64 - __builtin_clzll((uint64_t) usec);
+
+		if (bucket >= LATENCY_HISTOGRAM_BUCKETS)
+		{
+			bucket = LATENCY_HISTOGRAM_BUCKETS - 1;
+		}
+	}
+
+	histogram->buckets[bucket]++;
+	histogram->count++;
+
+	if (usec > histogram->max_usec)
+	{
+		histogram->max_usec = usec;
+	}
+}
+
+/**
+ * Copy up to num_buckets bucket counts, clearing any buckets beyond
+ * LATENCY_HISTOGRAM_BUCKETS
+ */
+void
+latency_histogram_copy(const latency_histogram_t *histogram,
+                       unsigned int *buckets, unsigned int num_buckets)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_buckets; i++)
+	{
+		buckets[i] = (i < LATENCY_HISTOGRAM_BUCKETS) ? histogram->buckets[i] : 0;
+	}
+}
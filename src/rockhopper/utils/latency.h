@@ -0,0 +1,49 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/**
+ * @file latency.h
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+/**
+ * Bucket 0 counts latencies below 1 usec, bucket i those in
+ * [2^(i-1), 2^i) usec; the last bucket also takes everything above.
+ */
+#define LATENCY_HISTOGRAM_BUCKETS   32
+
+typedef struct
+{
+	uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+	uint32_t count;
+	int64_t max_usec;
+} latency_histogram_t;
+
+clockid_t input_set_monotonic_clock(int fd);
+int64_t input_event_latency(clockid_t clock, const struct timeval *time);
+void latency_histogram_record(latency_histogram_t *histogram, int64_t usec);
+void latency_histogram_copy(const latency_histogram_t *histogram,
+                            unsigned int *buckets, unsigned int num_buckets);
+
+#endif // LATENCY_H_
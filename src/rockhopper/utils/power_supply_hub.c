@@ -0,0 +1,335 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/**
+ * @file power_supply_hub.c
+ *
+ * @brief Receive power_supply uevents once per process, parse them into a
+ * snapshot of all supplies and hand every change to the subscribed modules
+ *
+ * Built as a shared library: the modules using it are dlopen()ed separately,
+ * and each would carry its own copy of a static one.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libudev.h>
+
+#include <nyx/module/nyx_log.h>
+
+#include "power_supply_hub.h"
+
+typedef struct
+{
+	power_supply_callback_t callback;
+	void *context;
+} power_supply_subscriber_t;
+
+typedef struct
+{
+	struct udev *udev;
+	struct udev_monitor *mon;
+	guint watch;
+	gboolean dispatching;               /**< subscribers are being called */
+	int num_subscribers;
+	power_supply_subscriber_t subscribers[POWER_SUPPLY_MAX_SUBSCRIBERS];
+	int num_supplies;
+	power_supply_t supplies[POWER_SUPPLY_MAX_SUPPLIES];
+} power_supply_hub_t;
+
+static power_supply_hub_t hub;
+
+/* uevent variable of each integer property */
+static const char *prop_keys[PS_NUM_VALUES] =
+{
+	[PS_PROP_PRESENT]           = "POWER_SUPPLY_PRESENT",
+	[PS_PROP_ONLINE]            = "POWER_SUPPLY_ONLINE",
+	[PS_PROP_CAPACITY]          = "POWER_SUPPLY_CAPACITY",
+	[PS_PROP_TEMP]              = "POWER_SUPPLY_TEMP",
+	[PS_PROP_VOLTAGE_NOW]       = "POWER_SUPPLY_VOLTAGE_NOW",
+	[PS_PROP_CURRENT_NOW]       = "POWER_SUPPLY_CURRENT_NOW",
+	[PS_PROP_CHARGE_NOW]        = "POWER_SUPPLY_CHARGE_NOW",
+	[PS_PROP_CHARGE_FULL]       = "POWER_SUPPLY_CHARGE_FULL",
+	[PS_PROP_CHARGE_FULL_DESIGN] = "POWER_SUPPLY_CHARGE_FULL_DESIGN",
+};
+
+/**
+ * Find the snapshot entry of a supply, adding it if it is new. NULL if the
+ * snapshot is full.
+ */
+static power_supply_t *lookup_supply(const char *name)
+{
+	power_supply_t *supply;
+	int i;
+
+	for (i = 0; i < hub.num_supplies; i++)
+	{
+		if (strcmp(hub.supplies[i].name, name) == 0)
+		{
+			return &hub.supplies[i];
+		}
+	}
+
+	if (hub.num_supplies == POWER_SUPPLY_MAX_SUPPLIES)
+	{
+		return NULL;
+	}
+
+	supply = &hub.supplies[hub.num_supplies++];
+	memset(supply, 0, sizeof(power_supply_t));
+	g_strlcpy(supply->name, name, POWER_SUPPLY_NAME_LEN);
+
+	return supply;
+}
+
+/**
+ * Replace the snapshot of a supply with the properties of its uevent. The
+ * type is kept from earlier events, remove events carry none.
+ */
+static void parse_event(struct udev_device *dev, power_supply_t *supply)
+{
+	const char *action = udev_device_get_action(dev);
+	const char *text;
+	char *endptr;
+	long value;
+	int i;
+
+	supply->removed = (action && strcmp(action, "remove") == 0);
+	supply->valid = 0;
+
+	if ((text = udev_device_get_property_value(dev, "POWER_SUPPLY_TYPE")))
+	{
+		g_strlcpy(supply->type, text, POWER_SUPPLY_NAME_LEN);
+	}
+
+	for (i = 0; i < PS_NUM_VALUES; i++)
+	{
+		if (!(text = udev_device_get_property_value(dev, prop_keys[i])))
+		{
+			continue;
+		}
+
+		value = strtol(text, &endptr, 10);
+		if (endptr == text)
+		{
+			nyx_error("%s: Invalid %s of %s", __FUNCTION__, prop_keys[i], supply->name);
+			continue;
+		}
+
+		supply->values[i] = (int) value;
+		supply->valid |= 1u << i;
+	}
+
+	if ((text = udev_device_get_property_value(dev, "POWER_SUPPLY_STATUS")))
+	{
+		g_strlcpy(supply->status, text, POWER_SUPPLY_STATUS_LEN);
+		supply->valid |= 1u << PS_PROP_STATUS;
+	}
+}
+
+/* Drop the subscribers that unsubscribed while being called */
+static void drop_unsubscribed(void)
+{
+	int i = 0;
+
+	while (i < hub.num_subscribers)
+	{
+		if (hub.subscribers[i].callback)
+		{
+			i++;
+		}
+		else
+		{
+			hub.subscribers[i] = hub.subscribers[--hub.num_subscribers];
+		}
+	}
+}
+
+static void hub_stop(void);
+
+static gboolean handle_event(GIOChannel *channel, GIOCondition condition,
+                             gpointer data)
+{
+	struct udev_device *dev;
+	power_supply_t *supply;
+	const char *name;
+	int i;
+
+	if ((condition & G_IO_IN) != G_IO_IN)
+	{
+		return TRUE;
+	}
+
+	dev = udev_monitor_receive_device(hub.mon);
+	if (!dev)
+	{
+		return TRUE;
+	}
+
+	name = udev_device_get_sysname(dev);
+	supply = name ? lookup_supply(name) : NULL;
+
+	if (supply)
+	{
+		parse_event(dev, supply);
+
+		/* a callback may unsubscribe, see power_supply_hub_unsubscribe() */
+		hub.dispatching = TRUE;
+
+		for (i = 0; i < hub.num_subscribers; i++)
+		{
+			if (hub.subscribers[i].callback)
+			{
+				hub.subscribers[i].callback(supply, hub.subscribers[i].context);
+			}
+		}
+
+		hub.dispatching = FALSE;
+		drop_unsubscribed();
+
+		/* a supply added again under the same name starts over */
+		if (supply->removed)
+		{
+			*supply = hub.supplies[--hub.num_supplies];
+		}
+	}
+	else
+	{
+		nyx_error("%s: No room for power supply %s", __FUNCTION__, name ? name : "");
+	}
+
+	udev_device_unref(dev);
+
+	if (hub.num_subscribers == 0)
+	{
+		hub_stop();
+	}
+
+	return TRUE;
+}
+
+static int hub_start(void)
+{
+	GIOChannel *channel;
+
+	hub.udev = udev_new();
+	if (!hub.udev)
+	{
+		nyx_error("Could not initialize udev component; power supply status updates will not be available");
+		return -1;
+	}
+
+	hub.mon = udev_monitor_new_from_netlink(hub.udev, "kernel");
+	if (hub.mon == NULL)
+	{
+		nyx_error("Failed to create udev monitor for kernel events");
+		goto fail;
+	}
+	if (udev_monitor_filter_add_match_subsystem_devtype(hub.mon, "power_supply", NULL) < 0)
+	{
+		nyx_error("Failed to setup udev filter for power_supply subsytem events");
+		goto fail;
+	}
+	if (udev_monitor_enable_receiving(hub.mon) < 0)
+	{
+		nyx_error("Failed to enable receiving kernel events for power_supply subsytem");
+		goto fail;
+	}
+
+	channel = g_io_channel_unix_new(udev_monitor_get_fd(hub.mon));
+	hub.watch = g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_NVAL, handle_event, NULL);
+	g_io_channel_unref(channel);
+
+	return 0;
+
+fail:
+	if (hub.mon)
+	{
+		udev_monitor_unref(hub.mon);
+		hub.mon = NULL;
+	}
+	udev_unref(hub.udev);
+	hub.udev = NULL;
+	return -1;
+}
+
+static void hub_stop(void)
+{
+	g_source_remove(hub.watch);
+	udev_monitor_unref(hub.mon);
+	udev_unref(hub.udev);
+	memset(&hub, 0, sizeof(hub));
+}
+
+/**
+ * @brief Have callback called with every power_supply uevent
+ *
+ * The first subscriber starts the monitor on the default GLib main context.
+ *
+ * @retval 0 on success, -1 on failure
+ */
+int power_supply_hub_subscribe(power_supply_callback_t callback, void *context)
+{
+	if (!callback || hub.num_subscribers == POWER_SUPPLY_MAX_SUBSCRIBERS)
+	{
+		return -1;
+	}
+
+	if (hub.num_subscribers == 0 && hub_start() < 0)
+	{
+		return -1;
+	}
+
+	hub.subscribers[hub.num_subscribers].callback = callback;
+	hub.subscribers[hub.num_subscribers].context = context;
+	hub.num_subscribers++;
+
+	return 0;
+}
+
+/**
+ * @brief Stop calling a subscribed callback, the last one stops the monitor
+ */
+void power_supply_hub_unsubscribe(power_supply_callback_t callback,
+                                  void *context)
+{
+	int i;
+
+	for (i = 0; i < hub.num_subscribers; i++)
+	{
+		if (hub.subscribers[i].callback == callback &&
+		        hub.subscribers[i].context == context)
+		{
+			/* handle_event() drops it and stops once the others were called */
+			if (hub.dispatching)
+			{
+				hub.subscribers[i].callback = NULL;
+				return;
+			}
+
+			hub.subscribers[i] = hub.subscribers[--hub.num_subscribers];
+
+			if (hub.num_subscribers == 0)
+			{
+				hub_stop();
+			}
+			return;
+		}
+	}
+}
@@ -0,0 +1,91 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/**
+ * @file power_supply_hub.h
+ *
+ * @brief One udev monitor for the power_supply class, shared by all modules
+ * of the process
+ */
+
+#ifndef POWER_SUPPLY_HUB_H_
+#define POWER_SUPPLY_HUB_H_
+
+#include <stdbool.h>
+#include <string.h>
+
+#define POWER_SUPPLY_NAME_LEN       32
+#define POWER_SUPPLY_STATUS_LEN     64
+
+/* Supplies kept in the snapshot */
+#define POWER_SUPPLY_MAX_SUPPLIES   8
+
+/* Subscribers of the hub */
+#define POWER_SUPPLY_MAX_SUBSCRIBERS    4
+
+/* Integer properties parsed from the POWER_SUPPLY_* uevent variables */
+typedef enum
+{
+	PS_PROP_PRESENT = 0,
+	PS_PROP_ONLINE,
+	PS_PROP_CAPACITY,
+	PS_PROP_TEMP,
+	PS_PROP_VOLTAGE_NOW,
+	PS_PROP_CURRENT_NOW,
+	PS_PROP_CHARGE_NOW,
+	PS_PROP_CHARGE_FULL,
+	PS_PROP_CHARGE_FULL_DESIGN,
+	PS_NUM_VALUES,
+	PS_PROP_STATUS = PS_NUM_VALUES,     /**< text, see power_supply_t.status */
+} power_supply_prop_t;
+
+/**
+ * State of a supply as reported by its last uevent. Properties missing from
+ * the event, which the driver does not report, have their valid bit clear.
+ */
+typedef struct
+{
+	char name[POWER_SUPPLY_NAME_LEN];   /**< sysfs name, e.g. "battery" */
+	char type[POWER_SUPPLY_NAME_LEN];   /**< POWER_SUPPLY_TYPE, empty if unknown */
+	char status[POWER_SUPPLY_STATUS_LEN];
+	bool removed;                       /**< the supply went away */
+	unsigned int valid;                 /**< bit per power_supply_prop_t */
+	int values[PS_NUM_VALUES];
+} power_supply_t;
+
+/* Called from the GLib main loop for every power_supply uevent */
+typedef void (*power_supply_callback_t)(const power_supply_t *supply,
+                                        void *context);
+
+int power_supply_hub_subscribe(power_supply_callback_t callback, void *context);
+void power_supply_hub_unsubscribe(power_supply_callback_t callback,
+                                  void *context);
+
+static inline bool
+power_supply_has(const power_supply_t *supply, power_supply_prop_t prop)
+{
+	return (supply->valid & (1u << prop)) != 0;
+}
+
+static inline bool
+power_supply_is_type(const power_supply_t *supply, const char *type)
+{
+	return strcmp(supply->type, type) == 0;
+}
+
+#endif // POWER_SUPPLY_HUB_H_
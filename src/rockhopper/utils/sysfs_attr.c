@@ -0,0 +1,234 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/**
+ * @file sysfs_attr.c
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sysfs_attr.h"
+
+#define SYSFS_PATH_LEN 256
+
+/**
+ * Open attribute name of the sysfs directory dir, closing the file the
+ * attribute had open before.
+ *
+ * @retval 0 on success, -1 if dir is NULL or the attribute can not be opened
+ */
+int sysfs_attr_open(sysfs_attr_t *attr, const char *dir, const char *name)
+{
+	char path[SYSFS_PATH_LEN];
+
+	sysfs_attr_close(attr);
+
+	if (!dir)
+	{
+		return -1;
+	}
+
+	if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int) sizeof(path))
+	{
+		return -1;
+	}
+
+	attr->fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	return (attr->fd < 0) ? -1 : 0;
+}
+
+void sysfs_attr_close(sysfs_attr_t *attr)
+{
+	if (attr->fd >= 0)
+	{
+		close(attr->fd);
+		attr->fd = -1;
+	}
+}
+
+/**
+ * Read the text of an attribute into buf, without the trailing newline.
+ *
+ * @retval Length of the text, -1 if the attribute is closed or unreadable
+ */
+int sysfs_attr_read(const sysfs_attr_t *attr, char *buf, size_t len)
+{
+	ssize_t n;
+
+	if (attr->fd < 0 || len == 0)
+	{
+		return -1;
+	}
+
+	do
+	{
+		n = pread(attr->fd, buf, len - 1, 0);
+	}
+	while (n < 0 && errno == EINTR);
+
+	if (n < 0)
+	{
+		return -1;
+	}
+
+	while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' '))
+	{
+		n--;
+	}
+	buf[n] = '\0';
+
+	return (int) n;
+}
+
+/**
+ * Read a decimal integer attribute.
+ *
+ * @retval 0 on success, -1 if unreadable or not a number
+ */
+int sysfs_attr_read_int(const sysfs_attr_t *attr, long *value)
+{
+	char buf[SYSFS_ATTR_VALUE_LEN];
+	char *endptr;
+	long val;
+
+	if (sysfs_attr_read(attr, buf, sizeof(buf)) <= 0)
+	{
+		return -1;
+	}
+
+	errno = 0;
+	val = strtol(buf, &endptr, 10);
+	if (endptr == buf || errno == ERANGE)
+	{
+		return -1;
+	}
+
+	*value = val;
+
+	return 0;
+}
+
+/**
+ * Read a decimal attribute with an optional fraction, e.g. "1234.56", as a
+ * fixed-point integer with frac_digits fractional digits, "1234.56" being
+ * 123456 with 2 digits and 1234560 with 3. Extra fractional digits are
+ * truncated.
+ *
+ * @retval 0 on success, -1 if unreadable or not a number
+ */
+int sysfs_attr_read_fixed(const sysfs_attr_t *attr, unsigned int frac_digits,
+                          long *value)
+{
+	char buf[SYSFS_ATTR_VALUE_LEN];
+	const char *p = buf;
+	bool negative = false;
+	bool digits = false;
+	unsigned int i;
+	long val = 0;
+
+	if (sysfs_attr_read(attr, buf, sizeof(buf)) <= 0)
+	{
+		return -1;
+	}
+
+	while (*p == ' ' || *p == '\t')
+	{
+		p++;
+	}
+
+	if (*p == '-' || *p == '+')
+	{
+		negative = (*p == '-');
+		p++;
+	}
+
+	for (; *p >= '0' && *p <= '9'; p++)
+	{
+		val = val * 10 + (*p - '0');
+		digits = true;
+	}
+
+	if (*p == '.')
+	{
+		p++;
+	}
+
+	for (i = 0; i < frac_digits; i++)
+	{
+		val *= 10;
+		if (*p >= '0' && *p <= '9')
+		{
+			val += *p++ - '0';
+			digits = true;
+		}
+	}
+
+	if (!digits)
+	{
+		return -1;
+	}
+
+	*value = negative ? -val : val;
+
+	return 0;
+}
+
+/**
+ * Index of text in names, for attributes and uevent properties with a
+ * fixed set of values such as the power_supply status.
+ *
+ * @retval Index in names, -1 if text is none of them
+ */
+int sysfs_parse_enum(const char *text, const char *const *names, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (names[i] && strcmp(text, names[i]) == 0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Read an attribute with a fixed set of values.
+ *
+ * @retval Index in names, -1 if unreadable or none of them
+ */
+int sysfs_attr_read_enum(const sysfs_attr_t *attr, const char *const *names,
+                         int count)
+{
+	char buf[SYSFS_ATTR_VALUE_LEN];
+
+	if (sysfs_attr_read(attr, buf, sizeof(buf)) < 0)
+	{
+		return -1;
+	}
+
+	return sysfs_parse_enum(buf, names, count);
+}
@@ -0,0 +1,64 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/**
+ * @file sysfs_attr.h
+ *
+ * @brief Reads of sysfs attributes through descriptors kept open, into
+ * caller buffers and without allocating
+ */
+
+#ifndef SYSFS_ATTR_H_
+#define SYSFS_ATTR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Longest attribute text read by the parsing helpers */
+#define SYSFS_ATTR_VALUE_LEN    64
+
+/**
+ * Attribute opened once, see sysfs_attr_open(). Sysfs regenerates the value
+ * on every read from offset 0, so reads are a single pread() and the file
+ * is never reopened. fd is -1 while closed.
+ */
+typedef struct
+{
+	int fd;
+} sysfs_attr_t;
+
+#define SYSFS_ATTR_INIT { -1 }
+
+int sysfs_attr_open(sysfs_attr_t *attr, const char *dir, const char *name);
+void sysfs_attr_close(sysfs_attr_t *attr);
+
+int sysfs_attr_read(const sysfs_attr_t *attr, char *buf, size_t len);
+int sysfs_attr_read_int(const sysfs_attr_t *attr, long *value);
+int sysfs_attr_read_fixed(const sysfs_attr_t *attr, unsigned int frac_digits,
+                          long *value);
+int sysfs_attr_read_enum(const sysfs_attr_t *attr, const char *const *names,
+                         int count);
+
+int sysfs_parse_enum(const char *text, const char *const *names, int count);
+
+static inline bool sysfs_attr_is_open(const sysfs_attr_t *attr)
+{
+	return attr->fd >= 0;
+}
+
+#endif // SYSFS_ATTR_H_
@@ -32,6 +32,7 @@
 #include <fcntl.h>
 
 #include <nyx/module/nyx_log.h>
+#include "utils.h"
 
 /**
  * Returns string in pre-allocated buffer.
@@ -95,62 +96,165 @@ end:
 	return 0;
 }
 
-char* find_power_supply_sysfs_path(const char *device_type)
+#define POWER_SUPPLY_CLASS_DIR "/sys/class/power_supply"
+#define POWER_SUPPLY_TYPE_LEN 64
+
+/* Supply in the power_supply index */
+typedef struct
+{
+	gchar *name;
+	gchar *type;
+	gchar *path;
+} power_supply_entry_t;
+
+/* Supplies by sysfs name, owning the entries, and the first supply of each type */
+static GHashTable *supplies_by_name = NULL;
+static GHashTable *supplies_by_type = NULL;
+
+static void power_supply_entry_free(gpointer data)
+{
+	power_supply_entry_t *entry = (power_supply_entry_t *) data;
+
+	g_free(entry->name);
+	g_free(entry->type);
+	g_free(entry->path);
+	g_free(entry);
+}
+
+/**
+ * Add a supply to the index, reading its type from sysfs when not given.
+ */
+static void power_supply_index_add(const char *name, const char *type)
+{
+	power_supply_entry_t *entry;
+	char type_buf[POWER_SUPPLY_TYPE_LEN];
+	gchar *type_path;
+
+	entry = g_new0(power_supply_entry_t, 1);
+	entry->name = g_strdup(name);
+	entry->path = g_build_filename(POWER_SUPPLY_CLASS_DIR, name, NULL);
+
+	if (!type || type[0] == '\0')
+	{
+		type_path = g_build_filename(entry->path, "type", NULL);
+		type = (FileGetString(type_path, type_buf, sizeof(type_buf)) == 0) ? type_buf : "";
+		g_free(type_path);
+	}
+	entry->type = g_strdup(type);
+
+	g_hash_table_replace(supplies_by_name, entry->name, entry);
+	if (!g_hash_table_lookup(supplies_by_type, entry->type))
+	{
+		g_hash_table_insert(supplies_by_type, entry->type, entry);
+	}
+}
+
+/**
+ * Index every supply of the power_supply class in one pass over the
+ * directory, on first use.
+ */
+static void power_supply_index_build(void)
 {
 	GError *gerror = NULL;
-	GDir* dir;
-	GDir* subdir;
-	gchar* dir_path = NULL;
-	gchar* full_path = NULL;
-	const char *sub_dir_name;
-	const char *file_name;
-	char file_contents[64];
-	char base_dir[64] = "/sys/class/power_supply/";
-
-	dir = g_dir_open(base_dir, 0, &gerror);
-	if (gerror)
+	GDir *dir;
+	const char *name;
+
+	supplies_by_name = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+	                   power_supply_entry_free);
+	supplies_by_type = g_hash_table_new(g_str_hash, g_str_equal);
+
+	dir = g_dir_open(POWER_SUPPLY_CLASS_DIR, 0, &gerror);
+	if (!dir)
 	{
 		nyx_error( "%s: %s", __FUNCTION__, gerror->message);
 		g_error_free(gerror);
-		return NULL;
+		return;
 	}
 
-	while (sub_dir_name = g_dir_read_name(dir))
+	while ((name = g_dir_read_name(dir)))
 	{
 		// ignore hidden files
-		if ('.' == sub_dir_name[0])
+		if ('.' == name[0])
 		{
 			continue;
 		}
-		dir_path = g_build_filename(base_dir, sub_dir_name, NULL);
-		if (g_file_test(dir_path, G_FILE_TEST_IS_DIR))
+		power_supply_index_add(name, NULL);
+	}
+
+	g_dir_close(dir);
+}
+
+/**
+ * Returns the sysfs directory of the first supply of device_type, NULL if
+ * there is none. The string is owned by the index and stays valid until
+ * the supply is removed.
+ */
+const char* find_power_supply_sysfs_path(const char *device_type)
+{
+	power_supply_entry_t *entry;
+
+	if (!supplies_by_name)
+	{
+		power_supply_index_build();
+	}
+
+	entry = (power_supply_entry_t *) g_hash_table_lookup(supplies_by_type, device_type);
+
+	return entry ? entry->path : NULL;
+}
+
+/**
+ * Keep the index current with a power_supply uevent of supply name. A new
+ * supply is added with the type of the event, a removed one is dropped and
+ * another supply of its type, if any, takes its place.
+ * Returns true if the index changed.
+ */
+bool power_supply_index_update(const char *name, const char *type, bool removed)
+{
+	power_supply_entry_t *entry;
+	GHashTableIter iter;
+	gpointer value;
+
+	if (!supplies_by_name)
+	{
+		power_supply_index_build();
+	}
+
+	entry = (power_supply_entry_t *) g_hash_table_lookup(supplies_by_name, name);
+
+	if (!removed)
+	{
+		if (entry)
 		{
-			subdir = g_dir_open(dir_path, 0, &gerror);
-			if (gerror)
-			{
-				nyx_error( "%s: %s", __FUNCTION__, gerror->message);
-				g_error_free(gerror);
-				return NULL;
-			}
+			return false;
+		}
+		power_supply_index_add(name, type);
+		return true;
+	}
+
+	if (!entry)
+	{
+		return false;
+	}
+
+	if (g_hash_table_lookup(supplies_by_type, entry->type) == entry)
+	{
+		g_hash_table_remove(supplies_by_type, entry->type);
 
-			while (file_name = g_dir_read_name(subdir))
+		g_hash_table_iter_init(&iter, supplies_by_name);
+		while (g_hash_table_iter_next(&iter, NULL, &value))
+		{
+			power_supply_entry_t *other = (power_supply_entry_t *) value;
+
+			if (other != entry && strcmp(other->type, entry->type) == 0)
 			{
-				if (strcmp(file_name, "type") == 0)
-				{
-					full_path = g_build_filename(dir_path, file_name, NULL);
-					FileGetString(full_path, file_contents, 64);
-					if (strcmp(file_contents, device_type) == 0)
-					{
-						return dir_path;
-					}
-					g_free(full_path);
-					full_path = NULL;
-				}
+				g_hash_table_insert(supplies_by_type, other->type, other);
+				break;
 			}
 		}
-		g_free(dir_path);
-		dir_path = NULL;
 	}
 
-	return NULL;
+	g_hash_table_remove(supplies_by_name, name);
+
+	return true;
 }
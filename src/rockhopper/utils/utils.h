@@ -23,8 +23,11 @@
 #ifndef UTILS_H_
 #define UTILS_H_
 
+#include <stdbool.h>
+
 int FileGetString(const char *path, char *ret_string, size_t maxlen);
 int FileGetDouble(const char *path, double *ret_data);
-char* find_power_supply_sysfs_path(const char *device_type);
+const char* find_power_supply_sysfs_path(const char *device_type);
+bool power_supply_index_update(const char *name, const char *type, bool removed);
 
 #endif // UTILS_H_